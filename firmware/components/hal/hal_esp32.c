@@ -0,0 +1,113 @@
+#include "hal.h"
+
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <esp_log.h>
+
+static const char *TAG = "hal";
+
+/* every output on the low speed group (the only one on newer chips), timer n for channel n */
+#define HAL_PWM_SPEED_MODE LEDC_LOW_SPEED_MODE
+
+/* ---------------------------------- GPIO ---------------------------------- */
+
+esp_err_t hal_gpio_output(gpio_num_t pin)
+{
+  return gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+}
+
+esp_err_t hal_gpio_input(gpio_num_t pin, hal_pull_t pull)
+{
+  esp_err_t err = gpio_set_direction(pin, GPIO_MODE_INPUT);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  switch (pull)
+  {
+  case HAL_PULL_UP:
+    return gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+  case HAL_PULL_DOWN:
+    return gpio_set_pull_mode(pin, GPIO_PULLDOWN_ONLY);
+  default:
+    return gpio_set_pull_mode(pin, GPIO_FLOATING);
+  }
+}
+
+void hal_gpio_set(gpio_num_t pin, int level)
+{
+  gpio_set_level(pin, level);
+}
+
+int hal_gpio_get(gpio_num_t pin)
+{
+  return gpio_get_level(pin);
+}
+
+/* ----------------------------------- PWM ---------------------------------- */
+
+esp_err_t hal_pwm_init(hal_pwm_t pwm, gpio_num_t pin, uint32_t freq_hz, uint8_t resolution_bits)
+{
+  if (pwm >= HAL_PWM_MAX)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // needed by the fades and by ledc_set_duty_and_update(); only the first call installs it
+  static bool s_fade_installed = false;
+  if (!s_fade_installed)
+  {
+    esp_err_t err = ledc_fade_func_install(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+      ESP_LOGE(TAG, "Failed to install fade service (%s)", esp_err_to_name(err));
+      return err;
+    }
+    s_fade_installed = true;
+  }
+
+  ledc_timer_config_t timerConfig = {
+      .speed_mode = HAL_PWM_SPEED_MODE,
+      .duty_resolution = (ledc_timer_bit_t)resolution_bits,
+      .timer_num = (ledc_timer_t)pwm,
+      .freq_hz = freq_hz,
+      .clk_cfg = LEDC_AUTO_CLK,
+  };
+  esp_err_t err = ledc_timer_config(&timerConfig);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  ledc_channel_config_t channelConfig = {
+      .gpio_num = pin,
+      .speed_mode = HAL_PWM_SPEED_MODE,
+      .channel = (ledc_channel_t)pwm,
+      .intr_type = LEDC_INTR_DISABLE,
+      .timer_sel = (ledc_timer_t)pwm,
+      .duty = 0,
+      .hpoint = 0,
+  };
+  return ledc_channel_config(&channelConfig);
+}
+
+void hal_pwm_stop(hal_pwm_t pwm)
+{
+  ledc_stop(HAL_PWM_SPEED_MODE, (ledc_channel_t)pwm, 0);
+}
+
+void hal_pwm_set_duty(hal_pwm_t pwm, uint32_t duty)
+{
+  ledc_set_duty_and_update(HAL_PWM_SPEED_MODE, (ledc_channel_t)pwm, duty, 0);
+}
+
+void hal_pwm_set_freq(hal_pwm_t pwm, uint32_t freq_hz)
+{
+  ledc_set_freq(HAL_PWM_SPEED_MODE, (ledc_timer_t)pwm, freq_hz);
+}
+
+void hal_pwm_fade(hal_pwm_t pwm, uint32_t duty, uint32_t ms)
+{
+  ledc_set_fade_time_and_start(HAL_PWM_SPEED_MODE, (ledc_channel_t)pwm, duty, ms, LEDC_FADE_NO_WAIT);
+}
@@ -0,0 +1,516 @@
+#include "hal_sim.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *TAG = "hal_sim";
+
+/* keys the simulated matrix can hold */
+#define HAL_SIM_KEYS_MAX (32)
+
+/* scripts waiting behind the one playing */
+#define HAL_SIM_SCRIPTS_MAX (8)
+
+/* default time "k" keeps a key down, and then up; well above the default debounce */
+#define HAL_SIM_PRESS_MS (100)
+
+typedef enum
+{
+  PIN_UNUSED,
+  PIN_INPUT,
+  PIN_OUTPUT,
+} sim_pin_mode_t;
+
+typedef struct
+{
+  sim_pin_mode_t mode;
+  int level;
+  bool strobe; // keypad column, toggled on every scan and left out of the trace
+} sim_pin_t;
+
+typedef struct
+{
+  char key;
+  gpio_num_t row;
+  gpio_num_t col;
+  bool down;
+} sim_key_t;
+
+static sim_pin_t s_pins[GPIO_NUM_MAX];
+static sim_key_t s_keys[HAL_SIM_KEYS_MAX];
+static size_t s_key_count = 0;
+static hal_sim_pwm_state_t s_pwm[HAL_PWM_MAX];
+
+static hal_sim_event_t s_trace[HAL_SIM_TRACE_MAX];
+static uint32_t s_seq = 0; // seq of the next event
+
+// also taken by the static constructors of the keypad and the passcode
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static QueueHandle_t s_scripts;
+
+/* caller holds s_lock */
+static void record(hal_sim_kind_t kind, uint8_t index, uint32_t value)
+{
+  hal_sim_event_t *e = &s_trace[s_seq % HAL_SIM_TRACE_MAX];
+  e->seq = s_seq++;
+  e->time_us = esp_timer_get_time();
+  e->kind = kind;
+  e->index = index;
+  e->value = value;
+}
+
+static bool valid_pin(gpio_num_t pin)
+{
+  return pin >= 0 && pin < GPIO_NUM_MAX;
+}
+
+/* ---------------------------------- GPIO ---------------------------------- */
+
+esp_err_t hal_gpio_output(gpio_num_t pin)
+{
+  if (!valid_pin(pin))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_pins[pin].mode = PIN_OUTPUT;
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t hal_gpio_input(gpio_num_t pin, hal_pull_t pull)
+{
+  if (!valid_pin(pin))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_pins[pin].mode = PIN_INPUT;
+  s_pins[pin].level = pull == HAL_PULL_UP ? 1 : 0;
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+void hal_gpio_set(gpio_num_t pin, int level)
+{
+  if (!valid_pin(pin))
+  {
+    return;
+  }
+
+  level = level ? 1 : 0;
+  bool traced = false;
+
+  taskENTER_CRITICAL(&s_lock);
+  sim_pin_t *p = &s_pins[pin];
+  if (p->level != level)
+  {
+    p->level = level;
+    if (!p->strobe)
+    {
+      record(HAL_SIM_PIN, pin, level);
+      traced = true;
+    }
+  }
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (traced)
+  {
+    ESP_LOGD(TAG, "GPIO%d -> %d", pin, level);
+  }
+}
+
+int hal_gpio_get(gpio_num_t pin)
+{
+  if (!valid_pin(pin))
+  {
+    return 0;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  int level = s_pins[pin].level;
+
+  // a held key connects its row to its column while the scan drives the column high
+  for (size_t i = 0; i < s_key_count; i++)
+  {
+    if (s_keys[i].down && s_keys[i].row == pin && s_pins[s_keys[i].col].level)
+    {
+      level = 1;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&s_lock);
+  return level;
+}
+
+/* ----------------------------------- PWM ---------------------------------- */
+
+esp_err_t hal_pwm_init(hal_pwm_t pwm, gpio_num_t pin, uint32_t freq_hz, uint8_t resolution_bits)
+{
+  if (pwm >= HAL_PWM_MAX || !valid_pin(pin))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_pins[pin].mode = PIN_OUTPUT;
+  s_pwm[pwm] = (hal_sim_pwm_state_t){
+      .pin = pin,
+      .freq_hz = freq_hz,
+      .duty = 0,
+      .resolution_bits = resolution_bits,
+  };
+  record(HAL_SIM_PWM_FREQ, pwm, freq_hz);
+  taskEXIT_CRITICAL(&s_lock);
+
+  ESP_LOGD(TAG, "PWM%u on GPIO%d at %" PRIu32 " Hz", pwm, pin, freq_hz);
+  return ESP_OK;
+}
+
+static void pwm_update(hal_pwm_t pwm, hal_sim_kind_t kind, uint32_t value)
+{
+  if (pwm >= HAL_PWM_MAX)
+  {
+    return;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  if (kind == HAL_SIM_PWM_FREQ)
+  {
+    s_pwm[pwm].freq_hz = value;
+  }
+  else
+  {
+    // fades land at once; the trace keeps them apart from plain duty changes
+    s_pwm[pwm].duty = value;
+  }
+  record(kind, pwm, value);
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void hal_pwm_stop(hal_pwm_t pwm)
+{
+  pwm_update(pwm, HAL_SIM_PWM_DUTY, 0);
+}
+
+void hal_pwm_set_duty(hal_pwm_t pwm, uint32_t duty)
+{
+  pwm_update(pwm, HAL_SIM_PWM_DUTY, duty);
+}
+
+void hal_pwm_set_freq(hal_pwm_t pwm, uint32_t freq_hz)
+{
+  pwm_update(pwm, HAL_SIM_PWM_FREQ, freq_hz);
+}
+
+void hal_pwm_fade(hal_pwm_t pwm, uint32_t duty, uint32_t ms)
+{
+  pwm_update(pwm, HAL_SIM_PWM_FADE, duty);
+}
+
+/* ------------------------------- SIMULATION ------------------------------- */
+
+void hal_sim_keymap(char key, gpio_num_t row, gpio_num_t col)
+{
+  if (!valid_pin(row) || !valid_pin(col))
+  {
+    return;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  if (s_key_count < HAL_SIM_KEYS_MAX)
+  {
+    s_keys[s_key_count++] = (sim_key_t){.key = key, .row = row, .col = col, .down = false};
+  }
+  s_pins[col].strobe = true;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+/* caller holds s_lock */
+static sim_key_t *find_key(char key)
+{
+  for (size_t i = 0; i < s_key_count; i++)
+  {
+    if (s_keys[i].key == key)
+    {
+      return &s_keys[i];
+    }
+  }
+  return NULL;
+}
+
+esp_err_t hal_sim_key(char key, bool down)
+{
+  taskENTER_CRITICAL(&s_lock);
+  sim_key_t *k = find_key(key);
+  if (k)
+  {
+    k->down = down;
+  }
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (!k)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+  ESP_LOGD(TAG, "Key '%c' %s", key, down ? "down" : "up");
+  return ESP_OK;
+}
+
+void hal_sim_drive(gpio_num_t pin, int level)
+{
+  if (!valid_pin(pin))
+  {
+    return;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_pins[pin].level = level ? 1 : 0;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void hal_sim_pwm_state(hal_pwm_t pwm, hal_sim_pwm_state_t *state)
+{
+  if (pwm >= HAL_PWM_MAX)
+  {
+    *state = (hal_sim_pwm_state_t){.pin = GPIO_NUM_NC};
+    return;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  *state = s_pwm[pwm];
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (state->freq_hz == 0)
+  {
+    state->pin = GPIO_NUM_NC;
+  }
+}
+
+size_t hal_sim_trace(uint32_t since, hal_sim_event_t *events, size_t max)
+{
+  size_t count = 0;
+
+  taskENTER_CRITICAL(&s_lock);
+  uint32_t oldest = s_seq > HAL_SIM_TRACE_MAX ? s_seq - HAL_SIM_TRACE_MAX : 0;
+  for (uint32_t seq = since > oldest ? since : oldest; seq < s_seq && count < max; seq++)
+  {
+    events[count++] = s_trace[seq % HAL_SIM_TRACE_MAX];
+  }
+  taskEXIT_CRITICAL(&s_lock);
+  return count;
+}
+
+/* --------------------------------- SCRIPTS -------------------------------- */
+
+/* digits only, up to 9 of them so the value can't overflow */
+static bool parse_uint(const char *s, const char *end, uint32_t *value)
+{
+  if (s == end || end - s > 9)
+  {
+    return false;
+  }
+
+  uint32_t n = 0;
+  for (; s < end; s++)
+  {
+    if (!isdigit((unsigned char)*s))
+    {
+      return false;
+    }
+    n = n * 10 + (*s - '0');
+  }
+  *value = n;
+  return true;
+}
+
+static bool known_key(char key)
+{
+  taskENTER_CRITICAL(&s_lock);
+  bool found = find_key(key) != NULL;
+  taskEXIT_CRITICAL(&s_lock);
+  return found;
+}
+
+static void delay_ms(uint32_t ms)
+{
+  vTaskDelay(pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1);
+}
+
+/* with run false only checks the script, so a bad one is refused whole */
+static esp_err_t play(const char *script, bool run)
+{
+  uint32_t press_ms = HAL_SIM_PRESS_MS;
+  const char *p = script;
+
+  while (*p)
+  {
+    if (isspace((unsigned char)*p))
+    {
+      p++;
+      continue;
+    }
+
+    char cmd = *p++;
+    const char *end = p;
+    while (*end && !isspace((unsigned char)*end))
+    {
+      end++;
+    }
+
+    uint32_t n;
+    switch (cmd)
+    {
+    case 'k':
+      if (p == end)
+      {
+        return ESP_ERR_INVALID_ARG;
+      }
+      for (const char *k = p; k < end; k++)
+      {
+        if (!run)
+        {
+          if (!known_key(*k))
+          {
+            return ESP_ERR_INVALID_ARG;
+          }
+          continue;
+        }
+        hal_sim_key(*k, true);
+        delay_ms(press_ms);
+        hal_sim_key(*k, false);
+        delay_ms(press_ms);
+      }
+      break;
+
+    case 'h':
+      if (p == end || !known_key(*p) || !parse_uint(p + 1, end, &n))
+      {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (run)
+      {
+        hal_sim_key(*p, true);
+        delay_ms(n);
+        hal_sim_key(*p, false);
+        delay_ms(press_ms);
+      }
+      break;
+
+    case 'w':
+      if (!parse_uint(p, end, &n))
+      {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (run)
+      {
+        delay_ms(n);
+      }
+      break;
+
+    case 'p':
+      if (!parse_uint(p, end, &n) || n == 0)
+      {
+        return ESP_ERR_INVALID_ARG;
+      }
+      press_ms = n;
+      break;
+
+    case 'g':
+    {
+      const char *eq = memchr(p, '=', end - p);
+      uint32_t level;
+      if (!eq || !parse_uint(p, eq, &n) || n >= GPIO_NUM_MAX || !parse_uint(eq + 1, end, &level) || level > 1)
+      {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (run)
+      {
+        hal_sim_drive((gpio_num_t)n, level);
+      }
+      break;
+    }
+
+    default:
+      return ESP_ERR_INVALID_ARG;
+    }
+
+    p = end;
+  }
+  return ESP_OK;
+}
+
+static void script_task(void *arg)
+{
+  char *script;
+  while (true)
+  {
+    if (xQueueReceive(s_scripts, &script, portMAX_DELAY) == pdTRUE)
+    {
+      int64_t start = esp_timer_get_time();
+      play(script, true);
+      ESP_LOGI(TAG, "Script played in %lld ms", (long long)((esp_timer_get_time() - start) / 1000));
+      free(script);
+    }
+  }
+}
+
+esp_err_t hal_sim_start(const char *script)
+{
+  if (s_scripts)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_scripts = xQueueCreate(HAL_SIM_SCRIPTS_MAX, sizeof(char *));
+  if (!s_scripts)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  if (xTaskCreate(script_task, "sim_script", 4096, NULL, tskIDLE_PRIORITY + 2, NULL) != pdPASS)
+  {
+    vQueueDelete(s_scripts);
+    s_scripts = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+
+  ESP_LOGI(TAG, "Simulated pins, %u keys mapped", (unsigned)s_key_count);
+  return script ? hal_sim_run(script) : ESP_OK;
+}
+
+esp_err_t hal_sim_run(const char *script)
+{
+  if (!s_scripts)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t err = play(script, false);
+  if (err != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Script refused: \"%s\"", script);
+    return err;
+  }
+
+  char *copy = strdup(script);
+  if (!copy)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  if (xQueueSend(s_scripts, &copy, 0) != pdTRUE)
+  {
+    free(copy);
+    return ESP_ERR_TIMEOUT;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include "hal_sim_gpio.h"
+#else
+#include <driver/gpio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The only place the app touches pins. On the chip these are thin wrappers
+ * over the GPIO and LEDC drivers; on the linux target (hal_sim.c) they record
+ * what would have been driven and read back scripted inputs, so the same app
+ * runs as a host process.
+ */
+
+/* ---------------------------------- GPIO ---------------------------------- */
+
+typedef enum
+{
+  HAL_PULL_NONE,
+  HAL_PULL_UP,
+  HAL_PULL_DOWN,
+} hal_pull_t;
+
+esp_err_t hal_gpio_output(gpio_num_t pin);
+esp_err_t hal_gpio_input(gpio_num_t pin, hal_pull_t pull);
+
+void hal_gpio_set(gpio_num_t pin, int level);
+int hal_gpio_get(gpio_num_t pin);
+
+/* ----------------------------------- PWM ---------------------------------- */
+
+/* a PWM output, 0 .. HAL_PWM_MAX - 1; each has its own timer, so its own frequency */
+typedef uint8_t hal_pwm_t;
+
+#define HAL_PWM_MAX (4)
+
+/** @brief Route @p pwm to @p pin at @p freq_hz, starting at duty 0 */
+esp_err_t hal_pwm_init(hal_pwm_t pwm, gpio_num_t pin, uint32_t freq_hz, uint8_t resolution_bits);
+
+/** @brief Stop the output and drive the pin low */
+void hal_pwm_stop(hal_pwm_t pwm);
+
+/** @brief Set the duty at once, cancelling a fade in progress; safe from any task */
+void hal_pwm_set_duty(hal_pwm_t pwm, uint32_t duty);
+
+void hal_pwm_set_freq(hal_pwm_t pwm, uint32_t freq_hz);
+
+/** @brief Fade from the current duty to @p duty over @p ms, without waiting */
+void hal_pwm_fade(hal_pwm_t pwm, uint32_t duty, uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Simulated pins for the linux target. Outputs are recorded, inputs read back
+ * whatever a script drove them to, and keypad keys close a row/column pair the
+ * way the real matrix does, so the keypad scan runs unchanged.
+ */
+
+/* recorded output changes kept for hal_sim_trace(); older ones are dropped */
+#define HAL_SIM_TRACE_MAX (256)
+
+typedef enum
+{
+  HAL_SIM_PIN,       // index: pin, value: level
+  HAL_SIM_PWM_DUTY,  // index: pwm, value: duty
+  HAL_SIM_PWM_FREQ,  // index: pwm, value: Hz
+  HAL_SIM_PWM_FADE,  // index: pwm, value: target duty
+} hal_sim_kind_t;
+
+typedef struct
+{
+  uint32_t seq; // increases by one per event, never reused
+  int64_t time_us;
+  hal_sim_kind_t kind;
+  uint8_t index;
+  uint32_t value;
+} hal_sim_event_t;
+
+typedef struct
+{
+  gpio_num_t pin; // GPIO_NUM_NC until hal_pwm_init()
+  uint32_t freq_hz;
+  uint32_t duty;
+  uint8_t resolution_bits;
+} hal_sim_pwm_state_t;
+
+/** @brief Tell the simulator which row/column pair @p key closes; called by the keypad */
+void hal_sim_keymap(char key, gpio_num_t row, gpio_num_t col);
+
+/** @brief Press or release @p key; ESP_ERR_NOT_FOUND if it isn't in the keymap */
+esp_err_t hal_sim_key(char key, bool down);
+
+/** @brief Level hal_gpio_get() returns for input @p pin from now on */
+void hal_sim_drive(gpio_num_t pin, int level);
+
+/**
+ * @brief Start the script player, then queue @p script (may be NULL) as the first one
+ *
+ * Call once from app_main, before anything can call hal_sim_run().
+ */
+esp_err_t hal_sim_start(const char *script);
+
+/**
+ * @brief Queue @p script to be played on the simulator task
+ *
+ * Whitespace separated commands, played in order:
+ *   k<keys>      press and release each key in turn, e.g. "k1234#"
+ *   h<key><ms>   hold a key down, e.g. "h#3000"
+ *   w<ms>        wait
+ *   g<pin>=<0|1> drive an input, e.g. "g2=0"
+ *   p<ms>        how long "k" keeps each key down, and up (default 100)
+ *
+ * Scripts queued while one is playing follow it.
+ *
+ * @return ESP_ERR_INVALID_ARG on a malformed command or unknown key, before
+ *         anything is played; ESP_ERR_INVALID_STATE before hal_sim_start()
+ */
+esp_err_t hal_sim_run(const char *script);
+
+/**
+ * @brief Copy recorded events with seq >= @p since, oldest first
+ *
+ * Keypad column strobes are not recorded, they would flood the trace.
+ *
+ * @return number of events copied
+ */
+size_t hal_sim_trace(uint32_t since, hal_sim_event_t *events, size_t max);
+
+void hal_sim_pwm_state(hal_pwm_t pwm, hal_sim_pwm_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
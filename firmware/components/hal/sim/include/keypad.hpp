@@ -0,0 +1,175 @@
+#pragma once
+
+#include <array>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+
+#include "hal.h"
+#include "hal_sim.h"
+
+/*
+ * Stand-in for the esp-idf-keypad component on the linux target, where that
+ * component can't build (it talks to driver/gpio.h). Same interface and the
+ * same row/column scan, done through the HAL; every key is registered with the
+ * simulator so scripts can press it.
+ */
+
+#define KEYPAD_SIM_BUFFER_SIZE (10)
+#define KEYPAD_SIM_DEFAULT_DEBOUNCE (10 * 1000)
+#define KEYPAD_SIM_DEFAULT_HOLD (500 * 1000)
+
+template <size_t rows, size_t cols>
+class Keypad
+{
+public:
+  Keypad(std::array<std::array<char, cols>, rows> keymap,
+         std::array<gpio_num_t, rows> rowPins,
+         std::array<gpio_num_t, cols> colPins)
+      : m_rowPins(rowPins), m_colPins(colPins)
+  {
+    for (size_t r = 0; r < rows; r++)
+    {
+      for (size_t c = 0; c < cols; c++)
+      {
+        m_keys[r][c] = Key{keymap[r][c], KeyState::IDLE, 0};
+        hal_sim_keymap(keymap[r][c], rowPins[r], colPins[c]);
+      }
+    }
+
+    m_pressedKeyQueue = xQueueCreate(KEYPAD_SIM_BUFFER_SIZE, sizeof(char));
+    m_heldKeyQueue = xQueueCreate(KEYPAD_SIM_BUFFER_SIZE, sizeof(char));
+
+    for (auto pin : m_rowPins)
+    {
+      hal_gpio_input(pin, HAL_PULL_DOWN);
+    }
+    for (auto pin : m_colPins)
+    {
+      hal_gpio_output(pin);
+      hal_gpio_set(pin, 0);
+    }
+  }
+
+  void beginScanTask()
+  {
+    xTaskCreate(Keypad::foreverScanTask, "ScanKeypad", 2048, this, 1, &m_taskHandle);
+  }
+
+  bool getPressed(char &c, TickType_t timeout = 0)
+  {
+    return xQueueReceive(m_pressedKeyQueue, &c, timeout) == pdTRUE;
+  }
+
+  bool getHeld(char &c, TickType_t timeout = 0)
+  {
+    return xQueueReceive(m_heldKeyQueue, &c, timeout) == pdTRUE;
+  }
+
+  /** @brief Set debounce time in microseconds */
+  esp_err_t setDebounceTime(uint64_t debounceTime)
+  {
+    if (debounceTime > 1000 && debounceTime < m_holdTime - 100000)
+    {
+      m_debounceTime = debounceTime;
+      return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  /** @brief Set hold time in microseconds */
+  esp_err_t setHoldTime(uint64_t holdTime)
+  {
+    if (holdTime > m_debounceTime + 100000)
+    {
+      m_holdTime = holdTime;
+      return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  void scanKeys()
+  {
+    if (esp_timer_get_time() - m_lastScanTime > m_debounceTime)
+    {
+      for (size_t r = 0; r < rows; r++)
+      {
+        for (size_t c = 0; c < cols; c++)
+        {
+          hal_gpio_set(m_colPins[c], 1);
+          updateKey(r, c, hal_gpio_get(m_rowPins[r]) != 0);
+          hal_gpio_set(m_colPins[c], 0);
+        }
+      }
+      m_lastScanTime = esp_timer_get_time();
+    }
+  }
+
+private:
+  enum class KeyState
+  {
+    IDLE,
+    RELEASED,
+    PRESSED,
+    HELD,
+  };
+
+  struct Key
+  {
+    char chr;
+    KeyState state;
+    int64_t holdTimer;
+  };
+
+  TaskHandle_t m_taskHandle{nullptr};
+  QueueHandle_t m_pressedKeyQueue{nullptr};
+  QueueHandle_t m_heldKeyQueue{nullptr};
+
+  std::array<std::array<Key, cols>, rows> m_keys{};
+  std::array<gpio_num_t, rows> m_rowPins;
+  std::array<gpio_num_t, cols> m_colPins;
+
+  uint64_t m_lastScanTime{0};
+  uint64_t m_debounceTime{KEYPAD_SIM_DEFAULT_DEBOUNCE};
+  uint64_t m_holdTime{KEYPAD_SIM_DEFAULT_HOLD};
+
+  static void foreverScanTask(void *pvParameters)
+  {
+    auto *instance = static_cast<Keypad *>(pvParameters);
+    while (true)
+    {
+      instance->scanKeys();
+      vTaskDelay(1);
+    }
+  }
+
+  // same transitions as the real driver, so press and hold timing match the device
+  void updateKey(size_t r, size_t c, bool high)
+  {
+    Key &key = m_keys[r][c];
+    if (high)
+    {
+      if (key.state == KeyState::IDLE || key.state == KeyState::RELEASED)
+      {
+        key.state = KeyState::PRESSED;
+        xQueueSend(m_pressedKeyQueue, &key.chr, 0);
+        key.holdTimer = esp_timer_get_time();
+      }
+      else if (key.state == KeyState::PRESSED && esp_timer_get_time() - key.holdTimer > (int64_t)m_holdTime)
+      {
+        key.state = KeyState::HELD;
+        xQueueSend(m_heldKeyQueue, &key.chr, 0);
+      }
+    }
+    else if (key.state == KeyState::PRESSED || key.state == KeyState::HELD)
+    {
+      key.state = KeyState::RELEASED;
+    }
+    else if (key.state == KeyState::RELEASED)
+    {
+      key.state = KeyState::IDLE;
+    }
+  }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process-wide counters shared by every subsystem. Incrementing is a single
+ * relaxed atomic add, so it is safe (and cheap) from any task.
+ *
+ * To add a counter, append an id here and a row to s_metric_info in metrics.c.
+ */
+typedef enum
+{
+  METRIC_KEYPRESSES,
+  METRIC_VALIDATE_VALID,
+  METRIC_VALIDATE_INVALID,
+  METRIC_VALIDATE_COOLDOWN,
+  METRIC_VALIDATE_REQUIRE_RESET,
+  METRIC_LOCKOUTS,
+  METRIC_EVENT_STREAM_DROPS,
+  METRIC_WIFI_RECONNECTS,
+  METRIC_HTTP_THROTTLED,
+  METRIC_HTTP_RATE_LIMIT_EVICTIONS,
+
+  METRIC_COUNT
+} metric_id_t;
+
+typedef struct
+{
+  const char *family; // Prometheus metric name, e.g. "lockbox_keypresses_total"
+  const char *labels; // label set including braces, or "" for none
+  const char *help;   // one-line description, shared by a family
+} metric_info_t;
+
+void metrics_inc(metric_id_t id);
+void metrics_add(metric_id_t id, uint32_t n);
+uint32_t metrics_get(metric_id_t id);
+
+/** @brief Static description of a counter, used when exporting */
+const metric_info_t *metrics_info(metric_id_t id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+#include "metrics.h"
+
+#include <stdatomic.h>
+
+static const metric_info_t s_metric_info[METRIC_COUNT] = {
+    [METRIC_KEYPRESSES] = {"lockbox_keypresses_total", "", "Keys pressed on the keypad"},
+    [METRIC_VALIDATE_VALID] = {"lockbox_passcode_validations_total", "{result=\"valid\"}", "Passcode validation outcomes"},
+    [METRIC_VALIDATE_INVALID] = {"lockbox_passcode_validations_total", "{result=\"invalid\"}", "Passcode validation outcomes"},
+    [METRIC_VALIDATE_COOLDOWN] = {"lockbox_passcode_validations_total", "{result=\"cooldown\"}", "Passcode validation outcomes"},
+    [METRIC_VALIDATE_REQUIRE_RESET] = {"lockbox_passcode_validations_total", "{result=\"require_reset\"}", "Passcode validation outcomes"},
+    [METRIC_LOCKOUTS] = {"lockbox_lockouts_total", "", "Cooldowns and full locks entered"},
+    [METRIC_EVENT_STREAM_DROPS] = {"lockbox_event_stream_dropped_total", "", "Events dropped for slow /events subscribers"},
+    [METRIC_WIFI_RECONNECTS] = {"lockbox_wifi_reconnects_total", "", "Wi-Fi station reconnect attempts"},
+    [METRIC_HTTP_THROTTLED] = {"lockbox_http_throttled_total", "", "Requests answered with 429 by the per-client rate limiter"},
+    [METRIC_HTTP_RATE_LIMIT_EVICTIONS] = {"lockbox_http_rate_limit_evictions_total", "", "Clients evicted from the full rate limiter table"},
+};
+
+static atomic_uint_least32_t s_counters[METRIC_COUNT];
+
+void metrics_inc(metric_id_t id)
+{
+  metrics_add(id, 1);
+}
+
+void metrics_add(metric_id_t id, uint32_t n)
+{
+  if (id < METRIC_COUNT)
+  {
+    atomic_fetch_add_explicit(&s_counters[id], n, memory_order_relaxed);
+  }
+}
+
+uint32_t metrics_get(metric_id_t id)
+{
+  return id < METRIC_COUNT ? atomic_load_explicit(&s_counters[id], memory_order_relaxed) : 0;
+}
+
+const metric_info_t *metrics_info(metric_id_t id)
+{
+  return id < METRIC_COUNT ? &s_metric_info[id] : NULL;
+}
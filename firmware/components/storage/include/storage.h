@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <nvs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* namespaces that can hold a cached handle at once */
+#define STORAGE_MAX_HANDLES (8)
+
+/* write-behind queue: distinct keys waiting, and the largest value it takes */
+#define STORAGE_PENDING_MAX (8)
+#define STORAGE_VALUE_MAX (64)
+
+/*
+ * The one owner of the NVS partition. Every subsystem goes through here
+ * instead of calling nvs_flash_init() and nvs_open() itself, so the partition
+ * is initialized exactly once and each namespace is opened exactly once.
+ */
+
+/**
+ * @brief Initialize the NVS partition, erasing it if it is full or from a newer layout
+ *
+ * Safe to call from static constructors and from every subsystem: only the
+ * first call touches flash, later ones return the same result.
+ */
+esp_err_t storage_init(void);
+
+/**
+ * @brief Read-write handle for @p ns, opened on first use and then cached
+ *
+ * The handle stays open for the life of the program; don't nvs_close() it.
+ * @p ns must be a string literal (or otherwise outlive the program).
+ */
+esp_err_t storage_open(const char *ns, nvs_handle_t *handle);
+
+/* one value of a batched read */
+typedef struct
+{
+  const char *key;
+  nvs_type_t type; // NVS_TYPE_U8/U16/U32/I32/STR/BLOB
+  void *dst;
+  size_t size;     // in: capacity of dst (STR/BLOB); out: bytes read
+  esp_err_t err;   // ESP_OK, ESP_ERR_NVS_NOT_FOUND, ...
+} storage_item_t;
+
+/**
+ * @brief Read all of a subsystem's settings with one open and one lock
+ *
+ * Missing keys are not an error: check each item's err.
+ *
+ * @return an error only if the namespace couldn't be opened
+ */
+esp_err_t storage_read(const char *ns, storage_item_t *items, size_t count);
+
+/**
+ * @brief Queue a write, to be committed together with others shortly
+ *
+ * Returns as soon as the value is copied, without touching flash. Writes to a
+ * key already waiting replace it, so a value that changes several times
+ * within the deadline costs one flash write. Everything waiting is written
+ * and committed CONFIG_STORAGE_FLUSH_MS after the first queued write, on
+ * storage_flush(), when the queue is full, or on esp_restart().
+ *
+ * storage_read() sees queued values. @p ns and @p key follow storage_open()
+ * rules; @p type is one of the storage_item_t types.
+ *
+ * @return ESP_ERR_INVALID_SIZE if @p len exceeds STORAGE_VALUE_MAX (write it directly instead)
+ */
+esp_err_t storage_set(const char *ns, const char *key, nvs_type_t type, const void *data, size_t len);
+
+/** @brief storage_set() for a NUL-terminated string */
+esp_err_t storage_set_str(const char *ns, const char *key, const char *value);
+
+/** @brief Write and commit everything queued now; e.g. before a deliberate power-off */
+esp_err_t storage_flush(void);
+
+typedef struct
+{
+  esp_err_t init_err;     // result of storage_init()
+  uint32_t init_us;       // time nvs_flash_init (and any erase) took
+  bool erased;            // the partition was wiped at boot
+  uint32_t handles;       // namespaces opened
+  size_t used_entries;    // nvs_get_stats()
+  size_t free_entries;
+  size_t total_entries;
+  size_t namespaces;
+  uint32_t commits;       // flushes that wrote something
+  uint32_t coalesced;     // queued writes replaced before reaching flash
+  uint32_t pending;       // writes waiting now
+  uint64_t bytes_written; // value bytes written by flushes
+} storage_stats_t;
+
+void storage_get_stats(storage_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
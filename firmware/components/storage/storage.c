@@ -0,0 +1,399 @@
+#include "storage.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <nvs_flash.h>
+
+static const char *TAG = "storage";
+
+typedef struct
+{
+  const char *ns;
+  nvs_handle_t handle;
+} storage_handle_t;
+
+static bool s_initialized = false;
+static esp_err_t s_init_err = ESP_OK;
+static uint32_t s_init_us = 0;
+static bool s_erased = false;
+
+static storage_handle_t s_handles[STORAGE_MAX_HANDLES];
+static size_t s_handle_count = 0;
+
+/* a write waiting for the next flush */
+typedef struct
+{
+  const char *ns;
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  nvs_type_t type;
+  uint16_t len;
+  uint8_t data[STORAGE_VALUE_MAX];
+} storage_pending_t;
+
+static storage_pending_t s_pending[STORAGE_PENDING_MAX];
+static size_t s_pending_count = 0;
+
+static uint32_t s_commits = 0;
+static uint32_t s_coalesced = 0;
+static uint64_t s_bytes_written = 0;
+
+// waits out the flush deadline; created with the first queued write
+static TaskHandle_t s_flush_task;
+
+// created on the first storage_init(), which runs before any task can race it
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+
+static void flush_on_shutdown(void)
+{
+  storage_flush();
+}
+
+esp_err_t storage_init(void)
+{
+  if (s_initialized)
+  {
+    return s_init_err;
+  }
+
+  s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = nvs_flash_init();
+  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+  {
+    // NVS partition was truncated and needs to be erased
+    ESP_LOGW(TAG, "NVS partition unusable (%s), erasing", esp_err_to_name(err));
+    err = nvs_flash_erase();
+    if (err == ESP_OK)
+    {
+      s_erased = true;
+      err = nvs_flash_init();
+    }
+  }
+  s_init_us = (uint32_t)(esp_timer_get_time() - start);
+
+  // queued writes reach flash on esp_restart() too (not on a brownout or panic reset)
+  esp_register_shutdown_handler(flush_on_shutdown);
+  s_init_err = err;
+  s_initialized = true;
+
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "NVS init failed (%s)", esp_err_to_name(err));
+  }
+  else
+  {
+    ESP_LOGI(TAG, "NVS ready in %" PRIu32 " us%s", s_init_us, s_erased ? " (erased)" : "");
+  }
+  return err;
+}
+
+/* Call with s_lock held */
+static esp_err_t open_locked(const char *ns, nvs_handle_t *handle)
+{
+  for (size_t i = 0; i < s_handle_count; i++)
+  {
+    if (strcmp(s_handles[i].ns, ns) == 0)
+    {
+      *handle = s_handles[i].handle;
+      return ESP_OK;
+    }
+  }
+
+  if (s_handle_count == STORAGE_MAX_HANDLES)
+  {
+    ESP_LOGE(TAG, "Handle cache full, can't open %s", ns);
+    return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t err = nvs_open(ns, NVS_READWRITE, handle);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Error (%s) opening namespace %s", esp_err_to_name(err), ns);
+    return err;
+  }
+
+  s_handles[s_handle_count].ns = ns;
+  s_handles[s_handle_count].handle = *handle;
+  s_handle_count++;
+  return ESP_OK;
+}
+
+esp_err_t storage_open(const char *ns, nvs_handle_t *handle)
+{
+  esp_err_t err = storage_init();
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  err = open_locked(ns, handle);
+  xSemaphoreGive(s_lock);
+  return err;
+}
+
+/* Call with s_lock held */
+static storage_pending_t *find_pending(const char *ns, const char *key)
+{
+  for (size_t i = 0; i < s_pending_count; i++)
+  {
+    if (strcmp(s_pending[i].ns, ns) == 0 && strcmp(s_pending[i].key, key) == 0)
+    {
+      return &s_pending[i];
+    }
+  }
+  return NULL;
+}
+
+/* a queued value answers reads before flash does */
+static esp_err_t read_pending(const storage_pending_t *p, storage_item_t *item)
+{
+  if (p->type != item->type)
+  {
+    return ESP_ERR_NVS_TYPE_MISMATCH;
+  }
+  if ((p->type == NVS_TYPE_STR || p->type == NVS_TYPE_BLOB) && item->size < p->len)
+  {
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+  memcpy(item->dst, p->data, p->len);
+  item->size = p->len;
+  return ESP_OK;
+}
+
+static esp_err_t read_item(nvs_handle_t handle, storage_item_t *item)
+{
+  switch (item->type)
+  {
+  case NVS_TYPE_U8:
+    item->size = sizeof(uint8_t);
+    return nvs_get_u8(handle, item->key, item->dst);
+  case NVS_TYPE_U16:
+    item->size = sizeof(uint16_t);
+    return nvs_get_u16(handle, item->key, item->dst);
+  case NVS_TYPE_U32:
+    item->size = sizeof(uint32_t);
+    return nvs_get_u32(handle, item->key, item->dst);
+  case NVS_TYPE_I32:
+    item->size = sizeof(int32_t);
+    return nvs_get_i32(handle, item->key, item->dst);
+  case NVS_TYPE_STR:
+    return nvs_get_str(handle, item->key, item->dst, &item->size);
+  case NVS_TYPE_BLOB:
+    return nvs_get_blob(handle, item->key, item->dst, &item->size);
+  default:
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+esp_err_t storage_read(const char *ns, storage_item_t *items, size_t count)
+{
+  esp_err_t err = storage_init();
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  nvs_handle_t handle;
+  err = open_locked(ns, &handle);
+  for (size_t i = 0; err == ESP_OK && i < count; i++)
+  {
+    storage_pending_t *p = find_pending(ns, items[i].key);
+    items[i].err = p ? read_pending(p, &items[i]) : read_item(handle, &items[i]);
+  }
+  xSemaphoreGive(s_lock);
+  return err;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static esp_err_t write_pending(nvs_handle_t handle, const storage_pending_t *p)
+{
+  switch (p->type)
+  {
+  case NVS_TYPE_U8:
+    return nvs_set_u8(handle, p->key, *(const uint8_t *)p->data);
+  case NVS_TYPE_U16:
+    return nvs_set_u16(handle, p->key, *(const uint16_t *)p->data);
+  case NVS_TYPE_U32:
+    return nvs_set_u32(handle, p->key, *(const uint32_t *)p->data);
+  case NVS_TYPE_I32:
+    return nvs_set_i32(handle, p->key, *(const int32_t *)p->data);
+  case NVS_TYPE_STR:
+    return nvs_set_str(handle, p->key, (const char *)p->data);
+  case NVS_TYPE_BLOB:
+    return nvs_set_blob(handle, p->key, p->data, p->len);
+  default:
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+/* Call with s_lock held. Writes every queued value, then commits each namespace once */
+static esp_err_t flush_locked(void)
+{
+  if (s_pending_count == 0)
+  {
+    return ESP_OK;
+  }
+
+  esp_err_t result = ESP_OK;
+  bool dirty[STORAGE_MAX_HANDLES] = {false};
+  uint32_t bytes = 0;
+
+  for (size_t i = 0; i < s_pending_count; i++)
+  {
+    const storage_pending_t *p = &s_pending[i];
+    nvs_handle_t handle;
+    esp_err_t err = open_locked(p->ns, &handle);
+    if (err == ESP_OK)
+    {
+      err = write_pending(handle, p);
+    }
+    if (err != ESP_OK)
+    {
+      // dropped rather than retried forever; the caller's RAM copy stays authoritative until reboot
+      ESP_LOGE(TAG, "Failed to write %s/%s (%s)", p->ns, p->key, esp_err_to_name(err));
+      result = err;
+      continue;
+    }
+
+    bytes += p->len;
+    for (size_t h = 0; h < s_handle_count; h++)
+    {
+      if (s_handles[h].handle == handle)
+      {
+        dirty[h] = true;
+      }
+    }
+  }
+
+  for (size_t h = 0; h < s_handle_count; h++)
+  {
+    if (dirty[h])
+    {
+      esp_err_t err = nvs_commit(s_handles[h].handle);
+      if (err != ESP_OK)
+      {
+        result = err;
+      }
+    }
+  }
+
+  ESP_LOGD(TAG, "Flushed %u writes (%" PRIu32 " bytes)", (unsigned)s_pending_count, bytes);
+  s_pending_count = 0;
+  s_commits++;
+  s_bytes_written += bytes;
+  return result;
+}
+
+esp_err_t storage_flush(void)
+{
+  if (!s_initialized || s_init_err != ESP_OK)
+  {
+    return s_init_err;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  esp_err_t err = flush_locked();
+  xSemaphoreGive(s_lock);
+  return err;
+}
+
+static void flush_task(void *arg)
+{
+  for (;;)
+  {
+    // woken by the first write after a flush; later ones ride along
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_STORAGE_FLUSH_MS));
+    storage_flush();
+  }
+}
+
+esp_err_t storage_set(const char *ns, const char *key, nvs_type_t type, const void *data, size_t len)
+{
+  if (len > STORAGE_VALUE_MAX || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  esp_err_t err = storage_init();
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+
+  storage_pending_t *p = find_pending(ns, key);
+  bool replaced = p != NULL;
+  if (replaced)
+  {
+    s_coalesced++;
+  }
+  else
+  {
+    // queue full: make room the slow way rather than lose a write
+    if (s_pending_count == STORAGE_PENDING_MAX)
+    {
+      flush_locked();
+    }
+    p = &s_pending[s_pending_count++];
+    p->ns = ns;
+    strcpy(p->key, key);
+  }
+  p->type = type;
+  p->len = len;
+  memcpy(p->data, data, len);
+
+  // the deadline runs from the first write after a flush, so a key that keeps changing still lands
+  bool start_deadline = s_pending_count == 1 && !replaced;
+  if (!s_flush_task)
+  {
+    xTaskCreate(flush_task, "storage", 3072, NULL, tskIDLE_PRIORITY + 1, &s_flush_task);
+  }
+
+  xSemaphoreGive(s_lock);
+
+  if (start_deadline && s_flush_task)
+  {
+    xTaskNotifyGive(s_flush_task);
+  }
+  return ESP_OK;
+}
+
+esp_err_t storage_set_str(const char *ns, const char *key, const char *value)
+{
+  return storage_set(ns, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+void storage_get_stats(storage_stats_t *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->init_err = s_init_err;
+  stats->init_us = s_init_us;
+  stats->erased = s_erased;
+  stats->handles = s_handle_count;
+  stats->commits = s_commits;
+  stats->coalesced = s_coalesced;
+  stats->pending = s_pending_count;
+  stats->bytes_written = s_bytes_written;
+
+  nvs_stats_t nvs;
+  if (s_initialized && s_init_err == ESP_OK && nvs_get_stats(NULL, &nvs) == ESP_OK)
+  {
+    stats->used_entries = nvs.used_entries;
+    stats->free_entries = nvs.free_entries;
+    stats->total_entries = nvs.total_entries;
+    stats->namespaces = nvs.namespace_count;
+  }
+}
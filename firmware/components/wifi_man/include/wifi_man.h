@@ -2,6 +2,9 @@
 
 #include <optional>
 #include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -13,12 +16,16 @@
 #include "esp_mac.h"
 #include "esp_wifi.h"
 #include "esp_wifi_netif.h"
+#include "esp_timer.h"
 //
-#include "nvs_flash.h"
+#include "storage.h"
+#include "wifi_stats.h"
+#include "wifi_power.h"
 
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
+ * - the link was lost and WIFI_STA_AUTO_RECONNECT is off, so no retry will follow
+ * Both are also reported as WifiState changes; the bits are for callers that want to block. */
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
@@ -34,6 +41,14 @@
 #define EXAMPLE_H2E_IDENTIFIER CONFIG_WIFI_STA_WPA3_PASSWORD_ID
 #endif
 
+#if CONFIG_WIFI_STA_PS_NONE
+#define WIFI_STA_PS_MODE WIFI_PS_NONE
+#elif CONFIG_WIFI_STA_PS_MAX_MODEM
+#define WIFI_STA_PS_MODE WIFI_PS_MAX_MODEM
+#else
+#define WIFI_STA_PS_MODE WIFI_PS_MIN_MODEM
+#endif
+
 // Configure auth mode threshold
 #if CONFIG_WIFI_STA_AUTH_OPEN
 #define WIFI_STA_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
@@ -59,6 +74,21 @@ enum class WifiMode
   AP
 };
 
+enum class WifiState
+{
+  IDLE,         // not started
+  CONNECTING,   // associating / waiting for an address
+  CONNECTED,    // associated and holding an IP
+  DISCONNECTED, // lost the AP, a reconnect is scheduled
+  FAILED,       // lost the AP with auto reconnect disabled
+};
+
+/* short lowercase name of a WifiState, used in logs and pushed events */
+char const *wifiStateName(WifiState state);
+
+/* called from the default event loop task; keep it short and non-blocking */
+using WifiStateCallback = std::function<void(WifiState state)>;
+
 typedef struct
 {
   uint8_t ssid[32] = CONFIG_WIFI_STA_SSID;
@@ -78,17 +108,105 @@ typedef struct
   std::optional<char const *> hostname;
 
   WifiStaConf sta;
+  // more networks to choose from; the strongest AP across sta and these wins
+  std::vector<WifiStaConf> networks;
   std::optional<WifiApConf> ap;
+
+  // notified on every state change, starting with the first CONNECTING
+  WifiStateCallback onStateChange;
 } WifiConf;
 
+/* an AP of one of our networks, as seen by the last scan */
+struct WifiScanEntry
+{
+  uint8_t bssid[6];
+  uint8_t channel;
+  int8_t rssi;
+  uint8_t network; // index into the network list
+};
+
+// APs kept from a scan; the rest are dropped
+#define WIFI_SCAN_CACHE_MAX (12)
+
 class Wifi
 {
 public:
+  // starts the driver and returns right away; progress is reported through conf.onStateChange
   Wifi(WifiConf const &conf);
 
+  WifiState state() const { return m_state.load(); }
+
+  // block until connected or failed, for callers that can't continue offline
+  bool waitConnected(TickType_t timeout);
+
+  // see wifi_power_set()
+  esp_err_t setPowerSave(wifi_ps_type_t mode, uint16_t listenInterval);
+  uint16_t listenInterval() const { return m_staConfig.sta.listen_interval; }
+
+private:
+  // consecutive failed attempts, drives the backoff; reset once an address is obtained
+  uint32_t m_retryNum{0};
+  esp_timer_handle_t m_reconnectTimer{nullptr};
+
+  std::atomic<WifiState> m_state{WifiState::IDLE};
+  WifiStateCallback m_onStateChange;
+
+  esp_netif_t *m_staNetif{nullptr};
+  wifi_config_t m_staConfig{};
+
+  // sta first, then conf.networks, then the Kconfig backup network
+  std::vector<WifiStaConf> m_networks;
+  size_t m_network{0};
+
+  /* ------------------------------- scan cache ------------------------------- */
+  enum class ScanFor
+  {
+    NONE,
+    CONNECT,
+    ROAM,
+  };
+  ScanFor m_scanFor{ScanFor::NONE};
+  std::array<WifiScanEntry, WIFI_SCAN_CACHE_MAX> m_scan{};
+  size_t m_scanCount{0};
+  int64_t m_scanTime{0}; // 0 when there is no usable scan
+
+  /* --------------------------------- roaming -------------------------------- */
+  uint8_t m_bssid[6]{};
+  bool m_roaming{false};       // we dropped the link on purpose to move to a better AP
+  bool m_roamRequested{false}; // RSSI went low; the next association to another BSSID is a roam
+  esp_timer_handle_t m_roamTimer{nullptr};
+
+  // set when a connect starts, cleared once an address is obtained
+  int64_t m_connectStart{0};
+
+  // current attempt targets the cached BSSID/channel instead of scanning
+  bool m_fastAttempt{false};
+
 private:
-  int staRetryMax = 10;
-  int staRetryNum = 0;
+  void setState(WifiState state);
+  void connect();
+
+  /* -------------------------------- reconnect ------------------------------- */
+  void scheduleReconnect();
+  void startConnect();
+  static void sReconnect(void *arg);
+
+  /* ---------------------------- network selection --------------------------- */
+  void useNetwork(size_t network, WifiScanEntry const *ap);
+  void startScan(ScanFor purpose);
+  void onScanDone();
+  WifiScanEntry const *strongest(int network, uint8_t const *exclude) const;
+  void connectStrongest();
+
+  /* --------------------------------- roaming -------------------------------- */
+  void onRssiLow();
+  void roamIfBetter();
+  static void sRoamArm(void *arg);
+
+  /* ------------------------------ fast connect ------------------------------ */
+  bool loadApCache();
+  void saveApCache(wifi_event_sta_connected_t const *event);
+  void applyStaticIp();
 
 private:
   static void sEventHandler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
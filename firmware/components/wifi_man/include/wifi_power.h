@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_wifi_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest listen interval the AP is asked for, in beacon intervals */
+#define WIFI_LISTEN_INTERVAL_MAX (100)
+
+/**
+ * @brief Switch the station power save mode at runtime
+ *
+ * The mode takes effect immediately. The listen interval (used by
+ * WIFI_PS_MAX_MODEM only) is negotiated at association, so a change applies
+ * from the next (re)connect.
+ *
+ * @return ESP_ERR_INVALID_STATE if the station isn't running, ESP_ERR_INVALID_ARG on a bad value
+ */
+esp_err_t wifi_power_set(wifi_ps_type_t mode, uint16_t listen_interval);
+
+void wifi_power_get(wifi_ps_type_t *mode, uint16_t *listen_interval);
+
+/* "none", "min_modem" or "max_modem" */
+const char *wifi_power_name(wifi_ps_type_t mode);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Station connection figures, readable from C (e.g. the /metrics exporter) */
+typedef struct
+{
+  uint32_t last_connect_ms;    // connect() to IP for the most recent connection
+  bool last_connect_fast;      // most recent connection went straight to the cached AP
+  uint32_t fast_connects;      // connections made through the cached BSSID/channel
+  uint32_t scan_connects;      // connections that needed a full scan
+  uint32_t disconnects;        // established links lost
+  uint32_t reconnect_delay_ms; // backoff before the pending reconnect, 0 if none
+  uint32_t offline_ms;         // current time without a link, 0 while connected
+  uint32_t scans;              // scans started, for connecting or roaming
+  uint32_t roam_attempts;      // times the signal fell below the roam threshold
+  uint32_t roams;              // moves to another AP after a low signal
+  uint64_t offline_ms_total;   // completed offline periods since boot
+} wifi_stats_t;
+
+void wifi_get_stats(wifi_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
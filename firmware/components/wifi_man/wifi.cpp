@@ -1,23 +1,119 @@
 #include "wifi_man.h"
+#include "metrics.h"
+#include "esp_random.h"
+#if CONFIG_ESP_WIFI_WNM_SUPPORT
+#include "esp_wnm.h"
+#endif
+
+#include <algorithm>
+#include <inttypes.h>
 
 static char const *const TAG = "wifi manager";
 
+#define WIFI_NVS_NAMESPACE "wifi_man"
+#define WIFI_AP_CACHE_KEY "ap_cache"
+
+// how long the reconnect timer waits for room in the event loop queue
+#define RECONNECT_POST_TIMEOUT_MS 10
+
+/* Timer callbacks hand their work to the event loop task, so all connection
+ * state is only ever touched from there */
+ESP_EVENT_DEFINE_BASE(WIFI_MAN_EVENT);
+enum
+{
+  WIFI_MAN_EVENT_RECONNECT,
+  WIFI_MAN_EVENT_ROAM_ARM,
+};
+
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
-Wifi::Wifi(WifiConf const &conf)
+static wifi_stats_t s_stats;
+static portMUX_TYPE s_statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// the station, for the C API; only one Wifi is ever constructed
+static Wifi *s_wifi;
+
+// m_staConfig is written from the event loop and from wifi_power_set() callers
+static portMUX_TYPE s_configLock = portMUX_INITIALIZER_UNLOCKED;
+
+// start of the current offline period, 0 while connected (guarded by s_statsLock)
+static int64_t s_offlineSince;
+
+/* last AP that gave us an address, kept in NVS across power cycles */
+struct WifiApCache
 {
-  /* -------------------------------- Init NVS -------------------------------- */
-  // initialize the nvs handle
-  esp_err_t err = nvs_flash_init();
-  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+  uint8_t ssid[32];
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+extern "C" void wifi_get_stats(wifi_stats_t *stats)
+{
+  taskENTER_CRITICAL(&s_statsLock);
+  *stats = s_stats;
+  int64_t since = s_offlineSince;
+  taskEXIT_CRITICAL(&s_statsLock);
+
+  stats->offline_ms = since ? (esp_timer_get_time() - since) / 1000 : 0;
+}
+
+extern "C" esp_err_t wifi_power_set(wifi_ps_type_t mode, uint16_t listen_interval)
+{
+  if (!s_wifi)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return s_wifi->setPowerSave(mode, listen_interval);
+}
+
+extern "C" void wifi_power_get(wifi_ps_type_t *mode, uint16_t *listen_interval)
+{
+  if (esp_wifi_get_ps(mode) != ESP_OK)
+  {
+    *mode = WIFI_PS_NONE;
+  }
+  *listen_interval = s_wifi ? s_wifi->listenInterval() : 0;
+}
+
+extern "C" const char *wifi_power_name(wifi_ps_type_t mode)
+{
+  switch (mode)
   {
-    // NVS partition was truncated and needs to be erased
-    // Retry nvs_flash_init
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    err = nvs_flash_init();
+  case WIFI_PS_NONE:
+    return "none";
+  case WIFI_PS_MIN_MODEM:
+    return "min_modem";
+  case WIFI_PS_MAX_MODEM:
+    return "max_modem";
   }
-  ESP_ERROR_CHECK(err);
+  return "unknown";
+}
+
+char const *wifiStateName(WifiState state)
+{
+  switch (state)
+  {
+  case WifiState::IDLE:
+    return "idle";
+  case WifiState::CONNECTING:
+    return "connecting";
+  case WifiState::CONNECTED:
+    return "connected";
+  case WifiState::DISCONNECTED:
+    return "disconnected";
+  case WifiState::FAILED:
+    return "failed";
+  }
+  return "unknown";
+}
+
+Wifi::Wifi(WifiConf const &conf)
+    : m_onStateChange{conf.onStateChange}
+{
+  /* -------------------------------- Init NVS -------------------------------- */
+  // the driver keeps PHY calibration in NVS; usually already up from static init
+  ESP_ERROR_CHECK(storage_init());
 
   // Initialize TCP/IP network interface (only call once in application)
   // Must be called prior to initializing the network driver!
@@ -36,6 +132,8 @@ Wifi::Wifi(WifiConf const &conf)
       WIFI_EVENT, ESP_EVENT_ANY_ID, &sEventHandler, this, nullptr));
   ESP_ERROR_CHECK(esp_event_handler_instance_register(
       IP_EVENT, IP_EVENT_STA_GOT_IP, &sEventHandler, this, nullptr));
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(
+      WIFI_MAN_EVENT, ESP_EVENT_ANY_ID, &sEventHandler, this, nullptr));
 
   if (conf.mode == WifiMode::STA)
   {
@@ -43,7 +141,34 @@ Wifi::Wifi(WifiConf const &conf)
 
     s_wifi_event_group = xEventGroupCreate();
 
+    esp_timer_create_args_t timer_args = {
+        .callback = &sReconnect,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_reconnect",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &m_reconnectTimer));
+
+#if CONFIG_WIFI_STA_ROAM
+    timer_args.callback = &sRoamArm;
+    timer_args.name = "wifi_roam";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &m_roamTimer));
+#endif
+
+    m_networks.push_back(conf.sta);
+    m_networks.insert(m_networks.end(), conf.networks.begin(), conf.networks.end());
+    if (sizeof(CONFIG_WIFI_STA_BACKUP_SSID) > 1)
+    {
+      WifiStaConf backup{};
+      memset(&backup, 0, sizeof(backup));
+      strncpy((char *)backup.ssid, CONFIG_WIFI_STA_BACKUP_SSID, sizeof(backup.ssid));
+      strncpy((char *)backup.password, CONFIG_WIFI_STA_BACKUP_PASSWORD, sizeof(backup.password));
+      m_networks.push_back(backup);
+    }
+
     esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+    m_staNetif = sta_netif;
 
     wifi_config_t wifi_config = {
         .sta = {
@@ -66,40 +191,471 @@ Wifi::Wifi(WifiConf const &conf)
     strncpy((char *)wifi_config.sta.ssid, (char *)conf.sta.ssid, sizeof(wifi_config.sta.ssid));
     strncpy((char *)wifi_config.sta.password, (char *)conf.sta.password, sizeof(wifi_config.sta.password));
 
+    // strongest AP on a full scan, not the first one found
+    wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    wifi_config.sta.listen_interval = CONFIG_WIFI_STA_LISTEN_INTERVAL;
+
+    // 802.11k/v: let APs that support it send neighbor reports and steer us
+    wifi_config.sta.rm_enabled = 1;
+    wifi_config.sta.btm_enabled = 1;
+    m_staConfig = wifi_config;
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &m_staConfig));
+
+#if CONFIG_WIFI_STA_FAST_CONNECT
+    m_fastAttempt = loadApCache();
+#endif
+
     ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_STA_PS_MODE));
+    s_wifi = this;
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
+    ESP_LOGI(TAG, "Power save: %s, listen interval %d", wifi_power_name(WIFI_STA_PS_MODE), CONFIG_WIFI_STA_LISTEN_INTERVAL);
+    ESP_LOGI(TAG, "wifi_init_sta finished, connecting in the background.");
+  }
+  else if (conf.ap)
+  {
+    ESP_LOGI(TAG, "Starting WiFi in AP mode...");
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
+    esp_netif_create_default_wifi_ap();
+  }
+}
 
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT)
+bool Wifi::waitConnected(TickType_t timeout)
+{
+  if (!s_wifi_event_group)
+  {
+    return false;
+  }
+
+  EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
+                                         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                         pdFALSE,
+                                         pdFALSE,
+                                         timeout);
+  return bits & WIFI_CONNECTED_BIT;
+}
+
+esp_err_t Wifi::setPowerSave(wifi_ps_type_t mode, uint16_t listenInterval)
+{
+  if (mode != WIFI_PS_NONE && mode != WIFI_PS_MIN_MODEM && mode != WIFI_PS_MAX_MODEM)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (listenInterval < 1 || listenInterval > WIFI_LISTEN_INTERVAL_MAX)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (listenInterval != m_staConfig.sta.listen_interval)
+  {
+    taskENTER_CRITICAL(&s_configLock);
+    m_staConfig.sta.listen_interval = listenInterval;
+    wifi_config_t config = m_staConfig;
+    taskEXIT_CRITICAL(&s_configLock);
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &config);
+    if (err != ESP_OK)
     {
-      ESP_LOGI(TAG, "connected to ap SSID:%s", CONFIG_WIFI_STA_SSID);
+      return err;
     }
-    else if (bits & WIFI_FAIL_BIT)
+  }
+
+  esp_err_t err = esp_wifi_set_ps(mode);
+  if (err == ESP_OK)
+  {
+    ESP_LOGI(TAG, "Power save: %s, listen interval %u", wifi_power_name(mode), listenInterval);
+  }
+  return err;
+}
+
+void Wifi::connect()
+{
+  if (!m_connectStart)
+  {
+    m_connectStart = esp_timer_get_time();
+  }
+  esp_wifi_connect();
+}
+
+/* -------------------------------- reconnect ------------------------------- */
+
+// capped exponential backoff, drawn from [delay/2, delay] so a roomful of boxes
+// coming back after an AP reboot don't all hit it in the same instant
+void Wifi::scheduleReconnect()
+{
+  uint32_t shift = std::min<uint32_t>(m_retryNum, 16);
+  uint32_t delay = std::min<uint64_t>((uint64_t)CONFIG_WIFI_STA_RECONNECT_MIN_MS << shift,
+                                      CONFIG_WIFI_STA_RECONNECT_MAX_MS);
+  delay = delay / 2 + esp_random() % (delay / 2 + 1);
+  m_retryNum++;
+
+  taskENTER_CRITICAL(&s_statsLock);
+  s_stats.reconnect_delay_ms = delay;
+  taskEXIT_CRITICAL(&s_statsLock);
+
+  ESP_LOGI(TAG, "Reconnect attempt %" PRIu32 " in %" PRIu32 " ms", m_retryNum, delay);
+
+  esp_timer_stop(m_reconnectTimer);
+  esp_timer_start_once(m_reconnectTimer, (uint64_t)delay * 1000);
+}
+
+// where to go: the cached AP, the strongest AP from a recent scan, or a new scan
+void Wifi::startConnect()
+{
+  if (!m_connectStart)
+  {
+    m_connectStart = esp_timer_get_time();
+  }
+
+  if (m_fastAttempt)
+  {
+    connect();
+  }
+  else if (m_scanTime && esp_timer_get_time() - m_scanTime < CONFIG_WIFI_STA_SCAN_CACHE_S * 1000000LL)
+  {
+    connectStrongest();
+  }
+  else
+  {
+    startScan(ScanFor::CONNECT);
+  }
+}
+
+// runs on the esp_timer task, so wait only briefly for room in the event queue;
+// a dropped post would leave the station offline with nothing left to retry it
+void Wifi::sReconnect(void *arg)
+{
+  Wifi *self = static_cast<Wifi *>(arg);
+  if (esp_event_post(WIFI_MAN_EVENT, WIFI_MAN_EVENT_RECONNECT, nullptr, 0, pdMS_TO_TICKS(RECONNECT_POST_TIMEOUT_MS)) != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Event queue full, retrying reconnect in %d ms", CONFIG_WIFI_STA_RECONNECT_MIN_MS);
+    esp_timer_start_once(self->m_reconnectTimer, (uint64_t)CONFIG_WIFI_STA_RECONNECT_MIN_MS * 1000);
+  }
+}
+
+/* ---------------------------- network selection --------------------------- */
+
+// point the driver at a network, and at one of its APs if given
+void Wifi::useNetwork(size_t network, WifiScanEntry const *ap)
+{
+  WifiStaConf const &net = m_networks[network];
+  m_network = network;
+
+  taskENTER_CRITICAL(&s_configLock);
+  memcpy(m_staConfig.sta.ssid, net.ssid, sizeof(net.ssid));
+  memcpy(m_staConfig.sta.password, net.password, sizeof(net.password));
+  if (ap)
+  {
+    memcpy(m_staConfig.sta.bssid, ap->bssid, sizeof(ap->bssid));
+    m_staConfig.sta.bssid_set = true;
+    m_staConfig.sta.channel = ap->channel;
+    m_staConfig.sta.scan_method = WIFI_FAST_SCAN;
+  }
+  else
+  {
+    m_staConfig.sta.bssid_set = false;
+    m_staConfig.sta.channel = 0;
+    m_staConfig.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+  }
+  wifi_config_t config = m_staConfig;
+  taskEXIT_CRITICAL(&s_configLock);
+
+  esp_wifi_set_config(WIFI_IF_STA, &config);
+}
+
+void Wifi::startScan(ScanFor purpose)
+{
+  // one scan at a time; a running one serves a connect just as well
+  if (m_scanFor != ScanFor::NONE)
+  {
+    if (purpose == ScanFor::CONNECT)
     {
-      ESP_LOGI(TAG, "Failed to connect to SSID:%s", CONFIG_WIFI_STA_SSID);
+      m_scanFor = purpose;
     }
-    else
+    return;
+  }
+
+  m_scanFor = purpose;
+  if (esp_wifi_scan_start(nullptr, false) != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Scan failed to start");
+    m_scanFor = ScanFor::NONE;
+    if (purpose == ScanFor::CONNECT)
     {
-      ESP_LOGE(TAG, "UNEXPECTED EVENT!");
+      // the driver can still find the first network on its own
+      useNetwork(0, nullptr);
+      connect();
     }
+    return;
   }
-  else if (conf.ap)
+
+  taskENTER_CRITICAL(&s_statsLock);
+  s_stats.scans++;
+  taskEXIT_CRITICAL(&s_statsLock);
+}
+
+// keep the APs of our networks from the driver's list, then act on it
+void Wifi::onScanDone()
+{
+  uint16_t count = 0;
+  esp_wifi_scan_get_ap_num(&count);
+
+  m_scanCount = 0;
+  wifi_ap_record_t record;
+  while (count-- > 0 && esp_wifi_scan_get_ap_record(&record) == ESP_OK)
   {
-    ESP_LOGI(TAG, "Starting WiFi in AP mode...");
+    for (size_t n = 0; n < m_networks.size(); n++)
+    {
+      if (strncmp((char const *)record.ssid, (char const *)m_networks[n].ssid, sizeof(m_networks[n].ssid)) != 0)
+      {
+        continue;
+      }
 
-    esp_netif_create_default_wifi_ap();
+      // table full: the weakest entry makes room for a stronger AP
+      WifiScanEntry *slot = nullptr;
+      if (m_scanCount < m_scan.size())
+      {
+        slot = &m_scan[m_scanCount++];
+      }
+      else
+      {
+        auto weakest = std::min_element(m_scan.begin(), m_scan.end(),
+                                        [](WifiScanEntry const &a, WifiScanEntry const &b)
+                                        { return a.rssi < b.rssi; });
+        slot = weakest->rssi < record.rssi ? &*weakest : nullptr;
+      }
+
+      if (slot)
+      {
+        memcpy(slot->bssid, record.bssid, sizeof(slot->bssid));
+        slot->channel = record.primary;
+        slot->rssi = record.rssi;
+        slot->network = n;
+      }
+      break;
+    }
+  }
+  esp_wifi_clear_ap_list();
+  m_scanTime = esp_timer_get_time();
+
+  ScanFor purpose = m_scanFor;
+  m_scanFor = ScanFor::NONE;
+  ESP_LOGI(TAG, "Scan found %u APs of our networks", (unsigned)m_scanCount);
+
+  if (purpose == ScanFor::CONNECT)
+  {
+    connectStrongest();
+  }
+#if CONFIG_WIFI_STA_ROAM
+  else if (purpose == ScanFor::ROAM)
+  {
+    roamIfBetter();
+  }
+#endif
+}
+
+// strongest cached AP, of one network (or any if network < 0), other than exclude
+WifiScanEntry const *Wifi::strongest(int network, uint8_t const *exclude) const
+{
+  WifiScanEntry const *best = nullptr;
+  for (size_t i = 0; i < m_scanCount; i++)
+  {
+    WifiScanEntry const &ap = m_scan[i];
+    if ((network >= 0 && ap.network != network) ||
+        (exclude && memcmp(ap.bssid, exclude, sizeof(ap.bssid)) == 0))
+    {
+      continue;
+    }
+    if (!best || ap.rssi > best->rssi)
+    {
+      best = &ap;
+    }
+  }
+  return best;
+}
+
+void Wifi::connectStrongest()
+{
+  WifiScanEntry const *ap = strongest(-1, nullptr);
+  if (ap)
+  {
+    ESP_LOGI(TAG, "Connecting to %s " MACSTR " (%d dBm)",
+             (char const *)m_networks[ap->network].ssid, MAC2STR(ap->bssid), ap->rssi);
+    useNetwork(ap->network, ap);
+  }
+  else
+  {
+    // nothing seen; scan again next time rather than trust an empty list
+    ESP_LOGI(TAG, "None of our networks in range, trying %s", (char const *)m_networks[0].ssid);
+    m_scanTime = 0;
+    useNetwork(0, nullptr);
+  }
+  connect();
+}
+
+/* --------------------------------- roaming -------------------------------- */
+
+#if CONFIG_WIFI_STA_ROAM
+void Wifi::onRssiLow()
+{
+  wifi_ap_record_t current;
+  if (esp_wifi_sta_get_ap_info(&current) != ESP_OK)
+  {
+    return;
+  }
+
+  ESP_LOGI(TAG, "RSSI %d dBm below %d, looking for a better AP", current.rssi, CONFIG_WIFI_STA_ROAM_RSSI);
+  m_roamRequested = true;
+
+  taskENTER_CRITICAL(&s_statsLock);
+  s_stats.roam_attempts++;
+  taskEXIT_CRITICAL(&s_statsLock);
+
+#if CONFIG_ESP_WIFI_WNM_SUPPORT
+  // 802.11v: the AP knows its neighbors (and their load); let it pick and steer us
+  if (esp_wnm_is_btm_supported_connection() &&
+      esp_wnm_send_bss_transition_mgmt_query(REASON_RSSI, NULL, 0) == 0)
+  {
+    ESP_LOGI(TAG, "Asked the AP for a BSS transition");
+  }
+  else
+#endif
+  {
+    startScan(ScanFor::ROAM);
+  }
+
+  // the threshold only re-arms after the interval, so a marginal signal can't make us flap
+  esp_timer_stop(m_roamTimer);
+  esp_timer_start_once(m_roamTimer, CONFIG_WIFI_STA_ROAM_INTERVAL_S * 1000000ULL);
+}
+
+void Wifi::roamIfBetter()
+{
+  wifi_ap_record_t current;
+  if (m_state != WifiState::CONNECTED || esp_wifi_sta_get_ap_info(&current) != ESP_OK)
+  {
+    return;
+  }
+
+  WifiScanEntry const *ap = strongest(m_network, current.bssid);
+  if (!ap || ap->rssi < current.rssi + CONFIG_WIFI_STA_ROAM_HYSTERESIS)
+  {
+    ESP_LOGI(TAG, "No AP %d dB stronger than %d dBm, staying", CONFIG_WIFI_STA_ROAM_HYSTERESIS, current.rssi);
+    return;
+  }
+
+  ESP_LOGI(TAG, "Roaming from " MACSTR " (%d dBm) to " MACSTR " (%d dBm)",
+           MAC2STR(current.bssid), current.rssi, MAC2STR(ap->bssid), ap->rssi);
+  m_roaming = true;
+  useNetwork(m_network, ap);
+  esp_wifi_disconnect();
+}
+
+void Wifi::sRoamArm(void *arg)
+{
+  esp_event_post(WIFI_MAN_EVENT, WIFI_MAN_EVENT_ROAM_ARM, nullptr, 0, 0);
+}
+#endif
+
+/* ------------------------------ fast connect ------------------------------ */
+
+// point the driver at the cached AP; true if there was one for a configured network
+bool Wifi::loadApCache()
+{
+  WifiApCache cache;
+  storage_item_t items[] = {
+      {.key = WIFI_AP_CACHE_KEY, .type = NVS_TYPE_BLOB, .dst = &cache, .size = sizeof(cache)},
+  };
+
+  if (storage_read(WIFI_NVS_NAMESPACE, items, 1) != ESP_OK ||
+      items[0].err != ESP_OK || items[0].size != sizeof(cache))
+  {
+    return false;
+  }
+
+  size_t network = 0;
+  while (network < m_networks.size() &&
+         memcmp(cache.ssid, m_networks[network].ssid, sizeof(cache.ssid)) != 0)
+  {
+    network++;
+  }
+  if (network == m_networks.size())
+  {
+    return false;
+  }
+
+  WifiScanEntry ap{};
+  memcpy(ap.bssid, cache.bssid, sizeof(ap.bssid));
+  ap.channel = cache.channel;
+  useNetwork(network, &ap);
+
+  ESP_LOGI(TAG, "Fast connect to " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+  return true;
+}
+
+void Wifi::saveApCache(wifi_event_sta_connected_t const *event)
+{
+  WifiApCache cache{};
+  memcpy(cache.ssid, m_staConfig.sta.ssid, sizeof(cache.ssid));
+  memcpy(cache.bssid, event->bssid, sizeof(cache.bssid));
+  cache.channel = event->channel;
+
+  // rewrite only when the AP changed; reconnects to the same one cost no flash wear
+  WifiApCache stored;
+  storage_item_t items[] = {
+      {.key = WIFI_AP_CACHE_KEY, .type = NVS_TYPE_BLOB, .dst = &stored, .size = sizeof(stored)},
+  };
+  if (storage_read(WIFI_NVS_NAMESPACE, items, 1) != ESP_OK || items[0].err != ESP_OK ||
+      items[0].size != sizeof(stored) || memcmp(&stored, &cache, sizeof(cache)) != 0)
+  {
+    // written behind: association isn't held up by flash, and roaming bursts coalesce
+    storage_set(WIFI_NVS_NAMESPACE, WIFI_AP_CACHE_KEY, NVS_TYPE_BLOB, &cache, sizeof(cache));
+  }
+}
+
+void Wifi::applyStaticIp()
+{
+#if CONFIG_WIFI_STA_STATIC_IP
+  // same order as the IDF static_ip example: DHCP off once associated, then the address
+  if (esp_netif_dhcpc_stop(m_staNetif) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to stop DHCP client");
+    return;
+  }
+
+  esp_netif_ip_info_t ip{};
+  ip.ip.addr = esp_ip4addr_aton(CONFIG_WIFI_STA_STATIC_IP_ADDR);
+  ip.netmask.addr = esp_ip4addr_aton(CONFIG_WIFI_STA_STATIC_NETMASK);
+  ip.gw.addr = esp_ip4addr_aton(CONFIG_WIFI_STA_STATIC_GW);
+
+  // posts IP_EVENT_STA_GOT_IP like a DHCP lease would
+  if (esp_netif_set_ip_info(m_staNetif, &ip) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to set static IP");
+    return;
+  }
+
+  esp_netif_dns_info_t dns{};
+  dns.ip.u_addr.ip4.addr = esp_ip4addr_aton(CONFIG_WIFI_STA_STATIC_DNS);
+  dns.ip.type = ESP_IPADDR_TYPE_V4;
+  esp_netif_set_dns_info(m_staNetif, ESP_NETIF_DNS_MAIN, &dns);
+#endif
+}
+
+void Wifi::setState(WifiState state)
+{
+  if (m_state.exchange(state) == state)
+  {
+    return;
+  }
+
+  ESP_LOGI(TAG, "State: %s", wifiStateName(state));
+  if (m_onStateChange)
+  {
+    m_onStateChange(state);
   }
 }
 
@@ -120,31 +676,106 @@ void Wifi::eventHandler(esp_event_base_t event_base, int32_t event_id, void *eve
     {
     case WIFI_EVENT_STA_START:
     {
-      esp_wifi_connect();
+      setState(WifiState::CONNECTING);
+      startConnect();
       break;
     }
 
     case WIFI_EVENT_STA_DISCONNECTED:
     {
-      if (staRetryNum++ < staRetryMax)
+      wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+      bool wasConnected = m_state == WifiState::CONNECTED;
+
+      xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+      ESP_LOGI(TAG, "Disconnected, reason %d", event->reason);
+
+      // dropped on purpose to move to a better AP: go there now, no backoff
+      if (m_roaming)
       {
-        esp_wifi_connect();
-        ESP_LOGI(TAG, "Retrying...");
+        m_roaming = false;
+        taskENTER_CRITICAL(&s_statsLock);
+        s_offlineSince = esp_timer_get_time();
+        taskEXIT_CRITICAL(&s_statsLock);
+
+        setState(WifiState::CONNECTING);
+        connect();
+        break;
       }
-      else
+
+      if (wasConnected)
       {
+        taskENTER_CRITICAL(&s_statsLock);
+        s_stats.disconnects++;
+        s_offlineSince = esp_timer_get_time();
+        taskEXIT_CRITICAL(&s_statsLock);
+      }
+
+      // the cached AP is gone or moved: scan once, without spending a retry
+      if (m_fastAttempt)
+      {
+        ESP_LOGI(TAG, "Fast connect failed, falling back to a scan");
+        m_fastAttempt = false;
+        startConnect();
+        break;
+      }
+
+      // the AP we picked didn't take us; don't pick it from the same list again
+      if (!wasConnected)
+      {
+        m_scanTime = 0;
+      }
+
+#if !CONFIG_WIFI_STA_AUTO_RECONNECT
+      // boot keeps trying until the first link; a lost link stays lost
+      if (wasConnected)
+      {
+        ESP_LOGI(TAG, "Lost SSID:%s, auto reconnect is disabled", CONFIG_WIFI_STA_SSID);
         xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        setState(WifiState::FAILED);
+        break;
       }
+#endif
 
+      // never give up: an unattended box has to come back on its own
+      setState(WifiState::DISCONNECTED);
+      scheduleReconnect();
       break;
     }
     case WIFI_EVENT_STA_CONNECTED:
-    { // reset the number of retries
-      staRetryNum = 0;
+    {
+      wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+      ESP_LOGI(TAG, "connected to ap SSID:%.*s " MACSTR " channel %u",
+               event->ssid_len, (char const *)event->ssid, MAC2STR(event->bssid), event->channel);
 
-      xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+      if (m_roamRequested && memcmp(m_bssid, event->bssid, sizeof(m_bssid)) != 0)
+      {
+        taskENTER_CRITICAL(&s_statsLock);
+        s_stats.roams++;
+        taskEXIT_CRITICAL(&s_statsLock);
+      }
+      m_roamRequested = false;
+      memcpy(m_bssid, event->bssid, sizeof(m_bssid));
+
+#if CONFIG_WIFI_STA_FAST_CONNECT
+      saveApCache(event);
+#endif
+      applyStaticIp();
+      break;
+    }
+
+    case WIFI_EVENT_SCAN_DONE:
+    {
+      onScanDone();
+      break;
+    }
+
+#if CONFIG_WIFI_STA_ROAM
+    case WIFI_EVENT_STA_BSS_RSSI_LOW:
+    {
+      onRssiLow();
       break;
     }
+#endif
 
     /* ----------------------------------- AP ----------------------------------- */
     case WIFI_EVENT_AP_STACONNECTED:
@@ -176,8 +807,84 @@ void Wifi::eventHandler(esp_event_base_t event_base, int32_t event_id, void *eve
     {
       ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
       ESP_LOGI(TAG, "IP Address: " IPSTR, IP2STR(&(event->ip_info.ip)));
+
+      if (m_connectStart)
+      {
+        uint32_t elapsed = (esp_timer_get_time() - m_connectStart) / 1000;
+        m_connectStart = 0;
+        ESP_LOGI(TAG, "Connected in %" PRIu32 " ms (%s)", elapsed, m_fastAttempt ? "cached AP" : "full scan");
+
+        taskENTER_CRITICAL(&s_statsLock);
+        s_stats.last_connect_ms = elapsed;
+        s_stats.last_connect_fast = m_fastAttempt;
+        if (m_fastAttempt)
+        {
+          s_stats.fast_connects++;
+        }
+        else
+        {
+          s_stats.scan_connects++;
+        }
+        taskEXIT_CRITICAL(&s_statsLock);
+      }
+
+      // the cached AP only gets its one try per boot; a later drop rescans normally
+      m_fastAttempt = false;
+
+      // a link that can't get an address is no better than none, so the backoff
+      // only resets here and not on association
+      m_retryNum = 0;
+
+      taskENTER_CRITICAL(&s_statsLock);
+      if (s_offlineSince)
+      {
+        s_stats.offline_ms_total += (esp_timer_get_time() - s_offlineSince) / 1000;
+        s_offlineSince = 0;
+      }
+      taskEXIT_CRITICAL(&s_statsLock);
+
+      // only usable once there is an address
+      xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
+      xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+      setState(WifiState::CONNECTED);
+
+#if CONFIG_WIFI_STA_ROAM
+      // one-shot: fires WIFI_EVENT_STA_BSS_RSSI_LOW once, re-armed by the roam timer
+      esp_wifi_set_rssi_threshold(CONFIG_WIFI_STA_ROAM_RSSI);
+#endif
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+  else if (event_base == WIFI_MAN_EVENT)
+  {
+    switch (event_id)
+    {
+    case WIFI_MAN_EVENT_RECONNECT:
+    {
+      taskENTER_CRITICAL(&s_statsLock);
+      s_stats.reconnect_delay_ms = 0;
+      taskEXIT_CRITICAL(&s_statsLock);
+
+      metrics_inc(METRIC_WIFI_RECONNECTS);
+      startConnect();
+      break;
+    }
+
+#if CONFIG_WIFI_STA_ROAM
+    case WIFI_MAN_EVENT_ROAM_ARM:
+    {
+      m_roamRequested = false;
+      if (m_state == WifiState::CONNECTED)
+      {
+        esp_wifi_set_rssi_threshold(CONFIG_WIFI_STA_ROAM_RSSI);
+      }
       break;
     }
+#endif
 
     default:
       break;
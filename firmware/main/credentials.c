@@ -0,0 +1,429 @@
+#include "credentials.h"
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+
+#include "storage.h"
+#include "http_auth.h"
+#include "http_async.h"
+#include "http_server.h"
+#include "json_writer.h"
+
+static const char *TAG = "credentials";
+
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+#define CREDENTIALS_NAMESPACE "credentials"
+#define CREDENTIALS_KEY "codes"
+
+/* request body is pulled through this much stack, whatever its size */
+#define CREDENTIALS_CHUNK (256)
+
+#define CREDENTIALS_BITMAP_BYTES ((CREDENTIALS_CODE_SPACE + 7) / 8)
+
+/*
+ * The code space is small enough to keep as a bitmap: membership is one bit
+ * test, the whole set is one fixed-size NVS blob, and an import of any length
+ * needs only a second bitmap to stage into.
+ */
+static uint8_t s_live[CREDENTIALS_BITMAP_BYTES];
+static uint32_t s_live_count = 0;
+static portMUX_TYPE s_live_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* one import at a time owns the staging bitmap */
+static uint8_t s_staging[CREDENTIALS_BITMAP_BYTES];
+static SemaphoreHandle_t s_import_lock = NULL;
+static StaticSemaphore_t s_import_lock_buf;
+
+static uint32_t count_codes(const uint8_t *bitmap)
+{
+  uint32_t count = 0;
+  for (size_t i = 0; i < CREDENTIALS_BITMAP_BYTES; i++)
+  {
+    count += __builtin_popcount(bitmap[i]);
+  }
+  return count;
+}
+
+esp_err_t credentials_init(void)
+{
+  if (!s_import_lock)
+  {
+    s_import_lock = xSemaphoreCreateMutexStatic(&s_import_lock_buf);
+  }
+
+  storage_item_t items[] = {
+      {.key = CREDENTIALS_KEY, .type = NVS_TYPE_BLOB, .dst = s_live, .size = sizeof(s_live)},
+  };
+  esp_err_t err = storage_read(CREDENTIALS_NAMESPACE, items, 1);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  err = items[0].err;
+  if (err == ESP_ERR_NVS_NOT_FOUND)
+  {
+    ESP_LOGI(TAG, "No user codes stored");
+    return ESP_OK;
+  }
+  if (err != ESP_OK || items[0].size != sizeof(s_live))
+  {
+    ESP_LOGE(TAG, "Stored user codes unreadable (%s), ignoring them", esp_err_to_name(err));
+    memset(s_live, 0, sizeof(s_live));
+    return err == ESP_OK ? ESP_ERR_INVALID_SIZE : err;
+  }
+
+  s_live_count = count_codes(s_live);
+  ESP_LOGI(TAG, "Loaded %" PRIu32 " user codes", s_live_count);
+  return ESP_OK;
+}
+
+bool credentials_contains(const char *code)
+{
+  uint32_t value = 0;
+  for (int i = 0; i < CREDENTIALS_CODE_DIGITS; i++)
+  {
+    if (code[i] < '0' || code[i] > '9')
+    {
+      return false;
+    }
+    value = value * 10 + (code[i] - '0');
+  }
+
+  taskENTER_CRITICAL(&s_live_lock);
+  bool found = s_live[value / 8] & (1u << (value % 8));
+  taskEXIT_CRITICAL(&s_live_lock);
+  return found;
+}
+
+uint32_t credentials_count(void)
+{
+  return s_live_count;
+}
+
+/* ---------------------------------- PARSER -------------------------------- */
+
+typedef enum
+{
+  CSV_LINE_START,
+  CSV_CODE,
+  CSV_REST, // code taken, ignore the other fields
+  CSV_COMMENT,
+} csv_state_t;
+
+typedef struct
+{
+  bool binary;
+  csv_state_t state;
+  uint32_t line;
+  uint8_t digits;
+  uint32_t value;
+  int pending;      // binary: low byte waiting for its high byte, -1 if none
+  uint32_t entries; // codes read so far, duplicates included
+  uint32_t unique;  // distinct codes staged so far
+  const char *error;
+} import_parser_t;
+
+static void stage(import_parser_t *p, uint32_t value)
+{
+  uint8_t bit = 1u << (value % 8);
+  p->entries++;
+  if (!(s_staging[value / 8] & bit))
+  {
+    s_staging[value / 8] |= bit;
+    p->unique++;
+  }
+}
+
+static bool csv_finish_code(import_parser_t *p)
+{
+  if (p->digits != CREDENTIALS_CODE_DIGITS)
+  {
+    p->error = "Code must be " STR(CREDENTIALS_CODE_DIGITS) " digits";
+    return false;
+  }
+  stage(p, p->value);
+  return true;
+}
+
+static bool csv_feed(import_parser_t *p, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    char c = data[i];
+    if (c == '\r')
+    {
+      continue;
+    }
+
+    switch (p->state)
+    {
+    case CSV_LINE_START:
+      if (c == '\n')
+      {
+        p->line++;
+      }
+      else if (c == '#')
+      {
+        p->state = CSV_COMMENT;
+      }
+      else if (c >= '0' && c <= '9')
+      {
+        p->state = CSV_CODE;
+        p->digits = 1;
+        p->value = c - '0';
+      }
+      else
+      {
+        p->error = "Line must start with a code";
+        return false;
+      }
+      break;
+
+    case CSV_CODE:
+      if (c >= '0' && c <= '9')
+      {
+        if (++p->digits > CREDENTIALS_CODE_DIGITS)
+        {
+          p->error = "Code must be " STR(CREDENTIALS_CODE_DIGITS) " digits";
+          return false;
+        }
+        p->value = p->value * 10 + (c - '0');
+      }
+      else if (c == ',' || c == '\n')
+      {
+        if (!csv_finish_code(p))
+        {
+          return false;
+        }
+        if (c == '\n')
+        {
+          p->state = CSV_LINE_START;
+          p->line++;
+        }
+        else
+        {
+          p->state = CSV_REST;
+        }
+      }
+      else
+      {
+        p->error = "Code must be " STR(CREDENTIALS_CODE_DIGITS) " digits";
+        return false;
+      }
+      break;
+
+    case CSV_REST:
+    case CSV_COMMENT:
+      if (c == '\n')
+      {
+        p->state = CSV_LINE_START;
+        p->line++;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+static bool binary_feed(import_parser_t *p, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    uint8_t b = (uint8_t)data[i];
+    if (p->pending < 0)
+    {
+      p->pending = b;
+      continue;
+    }
+
+    uint32_t value = (uint32_t)p->pending | ((uint32_t)b << 8);
+    p->pending = -1;
+    if (value >= CREDENTIALS_CODE_SPACE)
+    {
+      p->error = "Code out of range";
+      return false;
+    }
+    stage(p, value);
+  }
+  return true;
+}
+
+static bool parser_feed(import_parser_t *p, const char *data, size_t len)
+{
+  return p->binary ? binary_feed(p, data, len) : csv_feed(p, data, len);
+}
+
+static bool parser_end(import_parser_t *p)
+{
+  if (p->binary)
+  {
+    if (p->pending >= 0)
+    {
+      p->error = "Truncated code";
+      return false;
+    }
+    return true;
+  }
+
+  // last line without a newline
+  if (p->state == CSV_CODE)
+  {
+    return csv_finish_code(p);
+  }
+  return true;
+}
+
+/* -------------------------------- HANDLERS -------------------------------- */
+
+static esp_err_t commit(void)
+{
+  nvs_handle_t handle;
+  esp_err_t err = storage_open(CREDENTIALS_NAMESPACE, &handle);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  // NVS writes the new blob before erasing the old one, so power loss keeps one of them
+  err = nvs_set_blob(handle, CREDENTIALS_KEY, s_staging, sizeof(s_staging));
+  if (err == ESP_OK)
+  {
+    err = nvs_commit(handle);
+  }
+  return err;
+}
+
+static esp_err_t send_error(httpd_req_t *req, const import_parser_t *p)
+{
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+
+  httpd_resp_set_status(req, "400 Bad Request");
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_str(&w, "error", p->error);
+  json_kv_uint(&w, p->binary ? "code" : "line", (p->binary ? p->entries : p->line) + 1);
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+/* Call with s_import_lock held */
+static esp_err_t import_body(httpd_req_t *req)
+{
+  int64_t start = esp_timer_get_time();
+
+  import_parser_t parser = {.state = CSV_LINE_START, .pending = -1};
+  char content_type[32];
+  if (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) == ESP_OK)
+  {
+    parser.binary = strncmp(content_type, "application/octet-stream", 24) == 0;
+  }
+
+  memset(s_staging, 0, sizeof(s_staging));
+
+  char chunk[CREDENTIALS_CHUNK];
+  size_t remaining = req->content_len;
+
+  while (remaining > 0)
+  {
+    int ret = httpd_req_recv(req, chunk, MIN(remaining, sizeof(chunk)));
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+      continue;
+    }
+    if (ret <= 0)
+    {
+      return ESP_FAIL;
+    }
+    remaining -= ret;
+
+    // staging is simply dropped on error: nothing has touched flash yet
+    if (!parser_feed(&parser, chunk, ret))
+    {
+      ESP_LOGW(TAG, "Import rejected: %s", parser.error);
+      return send_error(req, &parser);
+    }
+  }
+
+  if (!parser_end(&parser))
+  {
+    ESP_LOGW(TAG, "Import rejected: %s", parser.error);
+    return send_error(req, &parser);
+  }
+
+  // the only flash write of the whole import
+  esp_err_t err = commit();
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to store user codes (%s)", esp_err_to_name(err));
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store codes");
+  }
+
+  taskENTER_CRITICAL(&s_live_lock);
+  memcpy(s_live, s_staging, sizeof(s_live));
+  s_live_count = parser.unique;
+  taskEXIT_CRITICAL(&s_live_lock);
+
+  uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+  uint32_t per_second = elapsed_us ? (uint32_t)((uint64_t)parser.entries * 1000000 / elapsed_us) : 0;
+  ESP_LOGI(TAG, "Imported %" PRIu32 " codes (%" PRIu32 " entries) in %" PRIu32 " ms, %" PRIu32 "/s",
+           parser.unique, parser.entries, elapsed_us / 1000, per_second);
+
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_uint(&w, "imported", parser.unique);
+  json_kv_uint(&w, "entries", parser.entries);
+  json_kv_uint(&w, "elapsed_ms", elapsed_us / 1000);
+  json_kv_uint(&w, "entries_per_s", per_second);
+  json_kv_uint(&w, "buffer_bytes", sizeof(s_staging) + sizeof(chunk));
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+static esp_err_t import_work(httpd_req_t *req)
+{
+  if (xSemaphoreTake(s_import_lock, 0) != pdTRUE)
+  {
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_sendstr(req, "Import already running");
+  }
+
+  esp_err_t err = import_body(req);
+  xSemaphoreGive(s_import_lock);
+  return err;
+}
+
+static esp_err_t import_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  // NVS commit takes tens of ms; keep it off the httpd task
+  return http_async_submit(req, import_work);
+}
+
+static const httpd_uri_t import_uri = {
+    .uri = "/credentials/import",
+    .method = HTTP_POST,
+    .handler = import_handler,
+    .user_ctx = NULL};
+
+esp_err_t credentials_register(httpd_handle_t server)
+{
+  if (!s_import_lock)
+  {
+    ESP_LOGW(TAG, "credentials_init() not called, initializing now");
+    credentials_init();
+  }
+  return http_server_register(server, &import_uri);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* user codes have the same shape as the passcode: this many decimal digits */
+#define CREDENTIALS_CODE_DIGITS (4)
+#define CREDENTIALS_CODE_SPACE (10000)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Load the stored user codes; call once after NVS is initialized */
+esp_err_t credentials_init(void);
+
+/** @brief True if @p code (CREDENTIALS_CODE_DIGITS digits) is an imported user code */
+bool credentials_contains(const char *code);
+
+/** @brief Number of user codes currently loaded */
+uint32_t credentials_count(void);
+
+/**
+ * @brief Register POST /credentials/import
+ *
+ * The body replaces the whole set of user codes. It is streamed through a small
+ * fixed buffer and validated as it arrives, so RAM use does not depend on the
+ * list size. Accepted formats, picked by Content-Type:
+ *   - text/csv (default): one code per line, anything after the first comma
+ *     is ignored, blank lines and lines starting with '#' are skipped
+ *   - application/octet-stream: little-endian uint16 codes
+ *
+ * Nothing is written unless the whole body is valid, and then it's one NVS
+ * write and one commit, so a failed import leaves the old set untouched.
+ */
+esp_err_t credentials_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,33 +1,107 @@
 #include "door.h"
+#include "event_stream.h"
+#include "status.h"
 
 const gpio_num_t doorStatePin = GPIO_NUM_2;
-const gpio_num_t doorLockStatePin = GPIO_NUM_5;
+// GPIO5 drives the first passcode LED
+const gpio_num_t doorLockStatePin = GPIO_NUM_22;
 
 DoorState doorState = DOOR_CLOSED;
 DoorLockState doorLockState = DOOR_LOCKED;
 
-void initDoor()
+static bool doorReady = false;
+
+// the contact has to read the same twice in a row, so bounce shorter than this is ignored
+#define DOOR_POLL_MS 50
+
+// the door switch pulls the pin low while the door is shut
+static DoorState readDoorState()
+{
+  return hal_gpio_get(doorStatePin) ? DOOR_OPENED : DOOR_CLOSED;
+}
+
+static void doorPollTask(void *arg)
+{
+  DoorState lastSample = doorState;
+  while (true)
+  {
+    vTaskDelay(pdMS_TO_TICKS(DOOR_POLL_MS));
+
+    DoorState sample = readDoorState();
+    if (sample != lastSample)
+    {
+      lastSample = sample;
+      continue;
+    }
+    if (sample == doorState)
+    {
+      continue;
+    }
+
+    doorState = sample;
+    status_set_door(doorState == DOOR_OPENED, doorLockState == DOOR_LOCKED);
+    event_stream_publish("door", doorState == DOOR_OPENED ? "{\"door\":\"open\"}" : "{\"door\":\"closed\"}");
+  }
+}
+
+esp_err_t initDoor()
 {
   // configure pin for the door
-  gpio_set_direction(doorStatePin, GPIO_MODE_INPUT);
-  gpio_set_pull_mode(doorStatePin, GPIO_PULLUP_ONLY);
+  esp_err_t err = hal_gpio_input(doorStatePin, HAL_PULL_UP);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  // configure pin for the door lock, and start locked
+  err = hal_gpio_output(doorLockStatePin);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+  hal_gpio_set(doorLockStatePin, 1);
+  doorLockState = DOOR_LOCKED;
 
-  // configure pin for the door lock
-  gpio_set_direction(doorLockStatePin, GPIO_MODE_OUTPUT);
+  doorReady = true;
+
+  // the door may already be open at boot
+  doorState = readDoorState();
+  status_set_door(doorState == DOOR_OPENED, true);
+  if (xTaskCreate(doorPollTask, "DoorPoll", 3072, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
 }
 
-void lockDoor()
+esp_err_t lockDoor()
 {
-  gpio_set_level(doorLockStatePin, 1);
+  if (!doorReady)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  hal_gpio_set(doorLockStatePin, 1);
   doorLockState = DOOR_LOCKED;
+  status_set_door(doorState == DOOR_OPENED, true);
 
   esp_rom_printf("Door locked!");
+  event_stream_publish("door", "{\"lock\":\"locked\"}");
+  return ESP_OK;
 };
 
-void unlockDoor()
+esp_err_t unlockDoor()
 {
-  gpio_set_level(doorLockStatePin, 0);
+  if (!doorReady)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  hal_gpio_set(doorLockStatePin, 0);
   doorLockState = DOOR_UNLOCKED;
+  status_set_door(doorState == DOOR_OPENED, false);
 
   esp_rom_printf("Door unlocked!");
+  event_stream_publish("door", "{\"lock\":\"unlocked\"}");
+  return ESP_OK;
 };
\ No newline at end of file
@@ -2,7 +2,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <driver/gpio.h>
+#include "hal.h"
 #include <esp_timer.h>
 
 #include "common.h"
@@ -23,7 +23,11 @@ typedef enum {
 extern DoorState doorState;
 extern DoorLockState doorLockState;
 
-void initDoor();
-void lockDoor();
-void unlockDoor();
+/*
+ * Configure the pins, drive the lock shut and start watching the door switch.
+ * Lock and unlock fail until the pins are configured.
+ */
+esp_err_t initDoor();
+esp_err_t lockDoor();
+esp_err_t unlockDoor();
 
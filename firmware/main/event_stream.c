@@ -0,0 +1,271 @@
+#include "event_stream.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+
+#include "metrics.h"
+#include "http_auth.h"
+#include "http_server.h"
+
+static const char *TAG = "event_stream";
+
+#if CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
+
+/* largest single "event: ...\ndata: ...\n\n" frame */
+#define EVENT_STREAM_FRAME_MAX (128)
+
+typedef struct
+{
+  int fd;           // subscriber socket, -1 when the slot is free
+  size_t len;       // bytes waiting to be flushed
+  uint32_t dropped; // events skipped because the buffer was full
+  char buf[CONFIG_LOCKBOX_EVENTS_CLIENT_BUFFER];
+} event_client_t;
+
+static httpd_handle_t s_server = NULL;
+
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buf;
+static event_client_t s_clients[CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS];
+
+static atomic_bool s_flush_queued = false;
+
+/* flushes only run on the httpd task, so one scratch buffer is enough */
+static char s_send_buf[CONFIG_LOCKBOX_EVENTS_CLIENT_BUFFER];
+
+static const char SSE_HANDSHAKE[] = "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Cache-Control: no-cache\r\n"
+                                    "Connection: keep-alive\r\n"
+                                    "\r\n"
+                                    "retry: 3000\n\n";
+
+/* ------------------------------- FLUSHING -------------------------------- */
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+  while (len > 0)
+  {
+    int ret = httpd_socket_send(s_server, fd, buf, len, 0);
+    if (ret <= 0)
+    {
+      return false;
+    }
+    buf += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+/* Runs on the httpd task via httpd_queue_work() */
+static void event_stream_flush(void *arg)
+{
+  // clear first so events published while we send queue another flush
+  atomic_store(&s_flush_queued, false);
+
+  for (size_t i = 0; i < CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS; i++)
+  {
+    event_client_t *client = &s_clients[i];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int fd = client->fd;
+    size_t len = client->len;
+    if (len)
+    {
+      memcpy(s_send_buf, client->buf, len);
+      client->len = 0;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (fd < 0 || len == 0)
+    {
+      continue;
+    }
+
+    if (!send_all(fd, s_send_buf, len))
+    {
+      ESP_LOGW(TAG, "Send to subscriber on socket %d failed, closing", fd);
+      httpd_sess_trigger_close(s_server, fd);
+    }
+  }
+}
+
+/* -------------------------------- SESSIONS -------------------------------- */
+
+/* Called by httpd when a subscriber's socket is closed */
+static void event_client_closed(void *ctx)
+{
+  event_client_t *client = (event_client_t *)ctx;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  ESP_LOGI(TAG, "Subscriber on socket %d disconnected (%" PRIu32 " events dropped)", client->fd, client->dropped);
+  client->fd = -1;
+  client->len = 0;
+  xSemaphoreGive(s_lock);
+}
+
+static esp_err_t events_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  int fd = httpd_req_to_sockfd(req);
+  event_client_t *client = NULL;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  for (size_t i = 0; i < CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS; i++)
+  {
+    if (s_clients[i].fd < 0)
+    {
+      client = &s_clients[i];
+      client->fd = fd;
+      client->len = 0;
+      client->dropped = 0;
+      break;
+    }
+  }
+  xSemaphoreGive(s_lock);
+
+  if (!client)
+  {
+    ESP_LOGW(TAG, "Event stream full, rejecting socket %d", fd);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  // httpd frees the slot through event_client_closed() when the socket goes away
+  req->sess_ctx = client;
+  req->free_ctx = event_client_closed;
+
+  // answer the handshake ourselves and return; the socket stays open for pushes
+  if (!send_all(fd, SSE_HANDSHAKE, sizeof(SSE_HANDSHAKE) - 1))
+  {
+    return ESP_FAIL;
+  }
+
+  ESP_LOGI(TAG, "Subscriber connected on socket %d", fd);
+  return ESP_OK;
+}
+
+static const httpd_uri_t events_uri = {
+    .uri = "/events",
+    .method = HTTP_GET,
+    .handler = events_get_handler,
+    .user_ctx = NULL};
+
+/* ---------------------------------- API ---------------------------------- */
+
+esp_err_t event_stream_register(httpd_handle_t server)
+{
+  if (!s_lock)
+  {
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  for (size_t i = 0; i < CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS; i++)
+  {
+    s_clients[i].fd = -1;
+    s_clients[i].len = 0;
+  }
+  xSemaphoreGive(s_lock);
+
+  s_server = server;
+  return http_server_register(server, &events_uri);
+}
+
+void event_stream_unregister(void)
+{
+  if (!s_lock)
+  {
+    return;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  s_server = NULL;
+  for (size_t i = 0; i < CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS; i++)
+  {
+    s_clients[i].fd = -1;
+    s_clients[i].len = 0;
+  }
+  xSemaphoreGive(s_lock);
+}
+
+void event_stream_publish(const char *event, const char *data)
+{
+  httpd_handle_t server = s_server;
+  if (!server)
+  {
+    return;
+  }
+
+  char frame[EVENT_STREAM_FRAME_MAX];
+  int len = snprintf(frame, sizeof(frame), "event: %s\ndata: %s\n\n", event, data);
+  if (len < 0 || len >= (int)sizeof(frame))
+  {
+    ESP_LOGW(TAG, "Event '%s' too large, not sent", event);
+    return;
+  }
+
+  bool pending = false;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  for (size_t i = 0; i < CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS; i++)
+  {
+    event_client_t *client = &s_clients[i];
+    if (client->fd < 0)
+    {
+      continue;
+    }
+
+    // slow client: drop this event for it rather than block the publisher
+    if (client->len + len > sizeof(client->buf))
+    {
+      client->dropped++;
+      metrics_inc(METRIC_EVENT_STREAM_DROPS);
+      continue;
+    }
+
+    memcpy(client->buf + client->len, frame, len);
+    client->len += len;
+    pending = true;
+  }
+  xSemaphoreGive(s_lock);
+
+  // a single queued flush drains every client
+  if (pending && !atomic_exchange(&s_flush_queued, true))
+  {
+    if (httpd_queue_work(server, event_stream_flush, NULL) != ESP_OK)
+    {
+      atomic_store(&s_flush_queued, false);
+      ESP_LOGW(TAG, "Failed to queue event flush");
+    }
+  }
+}
+
+#else
+
+esp_err_t event_stream_register(httpd_handle_t server)
+{
+  ESP_LOGD(TAG, "Event stream disabled");
+  return ESP_OK;
+}
+
+void event_stream_unregister(void)
+{
+}
+
+void event_stream_publish(const char *event, const char *data)
+{
+}
+
+#endif // CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register the /events Server-Sent Events endpoint on a running server
+ *
+ * Subscribers are kept in a fixed-size registry. The handler only answers the
+ * handshake and returns, so the socket stays open without pinning the httpd task.
+ */
+esp_err_t event_stream_register(httpd_handle_t server);
+
+/** @brief Forget the server handle and drop all subscribers (call before httpd_stop) */
+void event_stream_unregister(void);
+
+/**
+ * @brief Push an event to every subscriber
+ *
+ * Safe to call from any task. The event is appended to each client's bounded
+ * buffer and flushed asynchronously on the httpd task. Clients whose buffer is
+ * full miss this event instead of blocking the caller.
+ *
+ * @param event  SSE event name, e.g. "keypad"
+ * @param data   single-line payload (usually JSON)
+ */
+void event_stream_publish(const char *event, const char *data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+#include "http_arena.h"
+
+#include <stdalign.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "http_arena";
+
+typedef struct
+{
+  httpd_req_t *owner; // NULL while free
+  size_t used;
+  alignas(8) uint8_t buf[CONFIG_LOCKBOX_HTTP_ARENA_SIZE];
+} http_arena_t;
+
+static http_arena_t s_arenas[CONFIG_LOCKBOX_HTTP_ARENAS];
+
+/* guards owner and the stats; held for a few instructions only */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static http_arena_stats_t s_stats;
+
+/* Call with s_lock held */
+static http_arena_t *find(httpd_req_t *req)
+{
+  for (size_t i = 0; i < CONFIG_LOCKBOX_HTTP_ARENAS; i++)
+  {
+    if (s_arenas[i].owner == req)
+    {
+      return &s_arenas[i];
+    }
+  }
+  return NULL;
+}
+
+void *http_arena_alloc(httpd_req_t *req, size_t size)
+{
+  size = (size + 7) & ~(size_t)7;
+
+  taskENTER_CRITICAL(&s_lock);
+
+  http_arena_t *arena = find(req);
+  if (!arena && (arena = find(NULL)) != NULL)
+  {
+    arena->owner = req;
+    arena->used = 0;
+    if (++s_stats.in_use > s_stats.peak)
+    {
+      s_stats.peak = s_stats.in_use;
+    }
+  }
+
+  void *ptr = NULL;
+  if (arena && size <= sizeof(arena->buf) - arena->used)
+  {
+    ptr = arena->buf + arena->used;
+    arena->used += size;
+    if (arena->used > s_stats.high_water)
+    {
+      s_stats.high_water = arena->used;
+    }
+  }
+  else
+  {
+    s_stats.exhausted++;
+  }
+
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (!ptr)
+  {
+    ESP_LOGW(TAG, "No scratch space for %u bytes (%s)", (unsigned)size, arena ? "arena full" : "pool empty");
+  }
+  return ptr;
+}
+
+void http_arena_release(httpd_req_t *req)
+{
+  if (!req)
+  {
+    return;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  http_arena_t *arena = find(req);
+  if (arena)
+  {
+    arena->owner = NULL;
+    s_stats.in_use--;
+  }
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void http_arena_get_stats(http_arena_stats_t *stats)
+{
+  taskENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  taskEXIT_CRITICAL(&s_lock);
+}
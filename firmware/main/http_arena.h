@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_http_server.h>
+
+typedef struct
+{
+  uint32_t in_use;
+  uint32_t peak;       // most arenas held at once since boot
+  uint32_t exhausted;  // allocations refused: no free arena or arena full
+  uint32_t high_water; // most bytes any request used
+} http_arena_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scratch memory that lives until the request ends
+ *
+ * The first call for @p req takes a fixed-size arena from a static pool; later
+ * calls bump a pointer inside it. Nothing is freed individually: the dispatcher
+ * (or the async worker) calls http_arena_release() once the handler returns,
+ * so handlers never touch the heap and never fragment it.
+ *
+ * @return 8-byte aligned memory, or NULL when the pool or the arena is exhausted
+ */
+void *http_arena_alloc(httpd_req_t *req, size_t size);
+
+/** @brief Return the arena held by @p req, if any, to the pool */
+void http_arena_release(httpd_req_t *req);
+
+void http_arena_get_stats(http_arena_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
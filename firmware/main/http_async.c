@@ -0,0 +1,166 @@
+#include "http_async.h"
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+
+#include "http_arena.h"
+
+static const char *TAG = "http_async";
+
+/* a detached request and its handler, or a plain function when req is NULL */
+typedef struct
+{
+  httpd_req_t *req;
+  esp_err_t (*handler)(httpd_req_t *req);
+  void (*work)(void *arg);
+  void *arg;
+} http_async_job_t;
+
+static QueueHandle_t s_jobs = NULL;
+
+static atomic_uint s_active = 0;
+static atomic_uint s_peak = 0;
+static atomic_uint s_completed = 0;
+static atomic_uint s_rejected = 0;
+
+static void update_peak(void)
+{
+  unsigned depth = uxQueueMessagesWaiting(s_jobs) + atomic_load(&s_active);
+  unsigned peak = atomic_load(&s_peak);
+  while (depth > peak && !atomic_compare_exchange_weak(&s_peak, &peak, depth))
+  {
+  }
+}
+
+static void http_async_worker(void *arg)
+{
+  http_async_job_t job;
+
+  while (true)
+  {
+    if (xQueueReceive(s_jobs, &job, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+
+    atomic_fetch_add(&s_active, 1);
+    update_peak();
+
+    if (!job.req)
+    {
+      job.work(job.arg);
+      atomic_fetch_sub(&s_active, 1);
+      atomic_fetch_add(&s_completed, 1);
+      continue;
+    }
+
+    if (job.handler(job.req) != ESP_OK)
+    {
+      ESP_LOGW(TAG, "Async handler for %s failed", job.req->uri);
+    }
+
+    http_arena_release(job.req);
+
+    // hands the socket back to the httpd task and frees the request copy
+    httpd_req_async_handler_complete(job.req);
+
+    atomic_fetch_sub(&s_active, 1);
+    atomic_fetch_add(&s_completed, 1);
+  }
+}
+
+esp_err_t http_async_start(void)
+{
+  if (s_jobs)
+  {
+    return ESP_OK;
+  }
+
+  s_jobs = xQueueCreate(CONFIG_LOCKBOX_HTTP_ASYNC_QUEUE, sizeof(http_async_job_t));
+  if (!s_jobs)
+  {
+    ESP_LOGE(TAG, "Failed to create job queue");
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (int i = 0; i < CONFIG_LOCKBOX_HTTP_ASYNC_WORKERS; i++)
+  {
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "httpAsync%d", i);
+    if (xTaskCreate(http_async_worker, name, CONFIG_LOCKBOX_HTTP_ASYNC_STACK, NULL, tskIDLE_PRIORITY + 4, NULL) != pdPASS)
+    {
+      ESP_LOGE(TAG, "Failed to start worker %d", i);
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  ESP_LOGI(TAG, "Started %d workers, queue depth %d", CONFIG_LOCKBOX_HTTP_ASYNC_WORKERS, CONFIG_LOCKBOX_HTTP_ASYNC_QUEUE);
+  return ESP_OK;
+}
+
+static esp_err_t send_busy(httpd_req_t *req)
+{
+  atomic_fetch_add(&s_rejected, 1);
+  httpd_resp_set_status(req, "503 Service Unavailable");
+  httpd_resp_set_hdr(req, "Retry-After", "1");
+  return httpd_resp_send(req, NULL, 0);
+}
+
+esp_err_t http_async_submit(httpd_req_t *req, esp_err_t (*handler)(httpd_req_t *req))
+{
+  if (!s_jobs || uxQueueSpacesAvailable(s_jobs) == 0)
+  {
+    return send_busy(req);
+  }
+
+  http_async_job_t job = {.req = NULL, .handler = handler, .work = NULL, .arg = NULL};
+  esp_err_t err = httpd_req_async_handler_begin(req, &job.req);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to detach request (%s)", esp_err_to_name(err));
+    return err;
+  }
+
+  if (xQueueSend(s_jobs, &job, 0) != pdTRUE)
+  {
+    // lost a race for the last slot; answer on the copy we now own
+    send_busy(job.req);
+    httpd_req_async_handler_complete(job.req);
+    return ESP_OK;
+  }
+
+  update_peak();
+  return ESP_OK;
+}
+
+esp_err_t http_async_queue_work(void (*work)(void *arg), void *arg)
+{
+  if (!s_jobs)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  http_async_job_t job = {.req = NULL, .handler = NULL, .work = work, .arg = arg};
+  if (xQueueSend(s_jobs, &job, 0) != pdTRUE)
+  {
+    atomic_fetch_add(&s_rejected, 1);
+    return ESP_ERR_NO_MEM;
+  }
+
+  update_peak();
+  return ESP_OK;
+}
+
+void http_async_get_stats(http_async_stats_t *stats)
+{
+  stats->queued = s_jobs ? uxQueueMessagesWaiting(s_jobs) : 0;
+  stats->active = atomic_load(&s_active);
+  stats->peak = atomic_load(&s_peak);
+  stats->completed = atomic_load(&s_completed);
+  stats->rejected = atomic_load(&s_rejected);
+}
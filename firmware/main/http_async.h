@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+typedef struct
+{
+  uint32_t queued;    // requests waiting for a worker right now
+  uint32_t active;    // requests being handled by a worker right now
+  uint32_t peak;      // highest queued + active seen since boot
+  uint32_t completed; // requests finished on a worker since boot
+  uint32_t rejected;  // requests (503) and work items turned away because the queue was full
+} http_async_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create the worker pool (CONFIG_LOCKBOX_HTTP_ASYNC_WORKERS tasks)
+ *
+ * Safe to call again after a server restart; the pool is only created once.
+ */
+esp_err_t http_async_start(void);
+
+/**
+ * @brief Finish a slow request on a worker instead of the httpd task
+ *
+ * Call from a handler running on the httpd task, after any cheap checks, and
+ * return the result. The request is detached with
+ * httpd_req_async_handler_begin() and @p handler later runs on a worker with
+ * the detached copy. If the queue is full the client gets a 503 instead.
+ */
+esp_err_t http_async_submit(httpd_req_t *req, esp_err_t (*handler)(httpd_req_t *req));
+
+/**
+ * @brief Run @p work(@p arg) on a worker, for slow jobs that aren't an HTTP request
+ *
+ * Safe to call from any task. Doesn't block: returns ESP_ERR_NO_MEM if the
+ * queue is full and ESP_ERR_INVALID_STATE before http_async_start().
+ */
+esp_err_t http_async_queue_work(void (*work)(void *arg), void *arg);
+
+/** @brief Snapshot the pool counters */
+void http_async_get_stats(http_async_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,358 @@
+#include "http_auth.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include "esp_tls_crypto.h"
+#include "sdkconfig.h"
+
+#include "http_server.h"
+#include "json_writer.h"
+
+static const char *TAG = "http_auth";
+
+#define HTTPD_401 "401 UNAUTHORIZED" /*!< HTTP Response 401 */
+
+#if CONFIG_EXAMPLE_BASIC_AUTH
+
+/* token layout: 8 hex digits of expiry (seconds since boot), '.', 64 hex digits of HMAC */
+#define HTTP_AUTH_EXP_HEX_LEN (8)
+#define HTTP_AUTH_MAC_LEN (32)
+#define HTTP_AUTH_TOKEN_LEN (HTTP_AUTH_EXP_HEX_LEN + 1 + 2 * HTTP_AUTH_MAC_LEN)
+
+/* over TLS the browser must never send the session cookie in the clear */
+#if CONFIG_LOCKBOX_HTTPS
+#define HTTP_AUTH_COOKIE_SECURE "; Secure"
+#else
+#define HTTP_AUTH_COOKIE_SECURE ""
+#endif
+
+/* longest Cookie header searched for the session token */
+#define HTTP_AUTH_COOKIE_HDR_MAX (256)
+
+/* "Basic " + base64("user:pass"), computed once by http_auth_init() */
+static char s_expected[HTTP_AUTH_VALUE_MAX];
+static size_t s_expected_len = 0;
+
+/*
+ * HMAC-SHA256 key blocks (key ^ ipad) and (key ^ opad). The key is random and
+ * regenerated every boot, which revokes all old tokens. Only the pads are kept,
+ * never a live hash context: a context left mid-computation would hold on to
+ * the SHA accelerator on targets that lock it per context.
+ */
+#define HTTP_AUTH_HMAC_BLOCK (64)
+static uint8_t s_hmac_ipad[HTTP_AUTH_HMAC_BLOCK];
+static uint8_t s_hmac_opad[HTTP_AUTH_HMAC_BLOCK];
+
+static void token_key_init(void)
+{
+  uint8_t key[32];
+  esp_fill_random(key, sizeof(key));
+  for (size_t i = 0; i < HTTP_AUTH_HMAC_BLOCK; i++)
+  {
+    uint8_t k = i < sizeof(key) ? key[i] : 0;
+    s_hmac_ipad[i] = k ^ 0x36;
+    s_hmac_opad[i] = k ^ 0x5c;
+  }
+  memset(key, 0, sizeof(key));
+}
+
+esp_err_t http_auth_init(const char *username, const char *password)
+{
+  token_key_init();
+
+  // a shipped default would be the same on every box; nothing matches until one is set
+  s_expected_len = 0;
+  if (!password || password[0] == '\0')
+  {
+    ESP_LOGE(TAG, "No API password set (EXAMPLE_BASIC_AUTH_PASSWORD)");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  char user_info[(HTTP_AUTH_VALUE_MAX - 6) * 3 / 4];
+  int len = snprintf(user_info, sizeof(user_info), "%s:%s", username, password);
+  if (len < 0 || len >= (int)sizeof(user_info))
+  {
+    ESP_LOGE(TAG, "Credentials too long");
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  /* 6: The length of the "Basic " string */
+  size_t out = 0;
+  strcpy(s_expected, "Basic ");
+  int rc = esp_crypto_base64_encode((unsigned char *)s_expected + 6, sizeof(s_expected) - 6, &out,
+                                    (const unsigned char *)user_info, len);
+  memset(user_info, 0, sizeof(user_info));
+  if (rc != 0)
+  {
+    ESP_LOGE(TAG, "Failed to encode credentials (%d)", rc);
+    s_expected_len = 0;
+    return ESP_FAIL;
+  }
+
+  s_expected_len = 6 + out;
+  return ESP_OK;
+}
+
+static void send_unauthorized(httpd_req_t *req)
+{
+  httpd_resp_set_status(req, HTTPD_401);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Connection", "keep-alive");
+  httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"LockBox\"");
+  httpd_resp_send(req, NULL, 0);
+}
+
+/* compare len bytes without an early exit */
+static bool ct_equal(const char *a, const char *b, size_t len)
+{
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    diff |= (uint8_t)(a[i] ^ b[i]);
+  }
+  return diff == 0;
+}
+
+static bool basic_valid(const char *value, size_t len)
+{
+  // value sits in a zeroed buffer larger than s_expected, so reading s_expected_len bytes is safe
+  return s_expected_len > 0 && ct_equal(value, s_expected, s_expected_len) && len == s_expected_len;
+}
+
+/* --------------------------------- TOKENS --------------------------------- */
+
+static uint32_t now_seconds(void)
+{
+  return (uint32_t)(esp_timer_get_time() / (1000 * 1000));
+}
+
+/* one hash over pad || data on a stack context, freed before returning */
+static void sha256_pad(const uint8_t pad[HTTP_AUTH_HMAC_BLOCK], const uint8_t *data, size_t len,
+                       uint8_t out[HTTP_AUTH_MAC_LEN])
+{
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  mbedtls_sha256_update(&ctx, pad, HTTP_AUTH_HMAC_BLOCK);
+  mbedtls_sha256_update(&ctx, data, len);
+  mbedtls_sha256_finish(&ctx, out);
+  mbedtls_sha256_free(&ctx);
+}
+
+static void token_sign(uint32_t exp, char mac_hex[2 * HTTP_AUTH_MAC_LEN])
+{
+  static const char hex[] = "0123456789abcdef";
+
+  uint8_t msg[4] = {(uint8_t)(exp >> 24), (uint8_t)(exp >> 16), (uint8_t)(exp >> 8), (uint8_t)exp};
+  uint8_t inner[HTTP_AUTH_MAC_LEN];
+  uint8_t mac[HTTP_AUTH_MAC_LEN];
+
+  sha256_pad(s_hmac_ipad, msg, sizeof(msg), inner);
+  sha256_pad(s_hmac_opad, inner, sizeof(inner), mac);
+
+  for (size_t i = 0; i < HTTP_AUTH_MAC_LEN; i++)
+  {
+    mac_hex[2 * i] = hex[mac[i] >> 4];
+    mac_hex[2 * i + 1] = hex[mac[i] & 0xf];
+  }
+}
+
+/* one HMAC, no state lookup */
+static bool token_valid(const char *token, size_t len)
+{
+  if (len != HTTP_AUTH_TOKEN_LEN || token[HTTP_AUTH_EXP_HEX_LEN] != '.')
+  {
+    return false;
+  }
+
+  uint32_t exp = 0;
+  for (size_t i = 0; i < HTTP_AUTH_EXP_HEX_LEN; i++)
+  {
+    char c = token[i];
+    uint8_t nibble;
+    if (c >= '0' && c <= '9')
+    {
+      nibble = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      nibble = c - 'a' + 10;
+    }
+    else
+    {
+      return false;
+    }
+    exp = (exp << 4) | nibble;
+  }
+
+  if (exp < now_seconds())
+  {
+    return false;
+  }
+
+  char mac_hex[2 * HTTP_AUTH_MAC_LEN];
+  token_sign(exp, mac_hex);
+  return ct_equal(token + HTTP_AUTH_EXP_HEX_LEN + 1, mac_hex, sizeof(mac_hex));
+}
+
+static void token_issue(char token[HTTP_AUTH_TOKEN_LEN + 1])
+{
+  uint32_t exp = now_seconds() + CONFIG_LOCKBOX_AUTH_TOKEN_TTL;
+  snprintf(token, HTTP_AUTH_EXP_HEX_LEN + 2, "%08" PRIx32 ".", exp);
+  token_sign(exp, token + HTTP_AUTH_EXP_HEX_LEN + 1);
+  token[HTTP_AUTH_TOKEN_LEN] = '\0';
+}
+
+/* ---------------------------------- CHECK --------------------------------- */
+
+/* Find the session cookie in a stack copy of the Cookie header.
+ * httpd_req_get_cookie_val() would malloc a copy of the header on every call. */
+static bool cookie_token_valid(httpd_req_t *req)
+{
+  char cookies[HTTP_AUTH_COOKIE_HDR_MAX];
+
+  size_t len = httpd_req_get_hdr_value_len(req, "Cookie");
+  if (len == 0 || len >= sizeof(cookies) ||
+      httpd_req_get_hdr_value_str(req, "Cookie", cookies, sizeof(cookies)) != ESP_OK)
+  {
+    return false;
+  }
+
+  static const char name[] = HTTP_AUTH_COOKIE "=";
+  const char *p = cookies;
+  while (p && *p)
+  {
+    while (*p == ' ')
+    {
+      p++;
+    }
+
+    const char *end = strchr(p, ';');
+    size_t pair_len = end ? (size_t)(end - p) : strlen(p);
+    if (pair_len > sizeof(name) - 1 && strncmp(p, name, sizeof(name) - 1) == 0)
+    {
+      return token_valid(p + sizeof(name) - 1, pair_len - (sizeof(name) - 1));
+    }
+
+    p = end ? end + 1 : NULL;
+  }
+  return false;
+}
+
+bool http_auth_valid(httpd_req_t *req)
+{
+  char buf[HTTP_AUTH_VALUE_MAX] = {0};
+
+  size_t len = httpd_req_get_hdr_value_len(req, "Authorization");
+  if (len > 0 && len < sizeof(buf) &&
+      httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) == ESP_OK)
+  {
+    if (strncmp(buf, "Bearer ", 7) == 0)
+    {
+      if (token_valid(buf + 7, len - 7))
+      {
+        return true;
+      }
+    }
+    else if (basic_valid(buf, len))
+    {
+      return true;
+    }
+  }
+
+  // browsers (EventSource, WebSocket) can't set headers, so also accept the login cookie
+  return cookie_token_valid(req);
+}
+
+bool http_auth_check(httpd_req_t *req)
+{
+  if (http_auth_valid(req))
+  {
+    return true;
+  }
+
+  ESP_LOGD(TAG, "Not authenticated");
+  send_unauthorized(req);
+  return false;
+}
+
+/* ---------------------------------- LOGIN --------------------------------- */
+
+/* Verify basic credentials once and hand out a signed token */
+static esp_err_t login_post_handler(httpd_req_t *req)
+{
+  char buf[HTTP_AUTH_VALUE_MAX] = {0};
+
+  size_t len = httpd_req_get_hdr_value_len(req, "Authorization");
+  if (len == 0 || len >= sizeof(buf) ||
+      httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) != ESP_OK ||
+      !basic_valid(buf, len))
+  {
+    ESP_LOGI(TAG, "Login rejected");
+    send_unauthorized(req);
+    return ESP_OK;
+  }
+
+  char token[HTTP_AUTH_TOKEN_LEN + 1];
+  token_issue(token);
+
+  char cookie[HTTP_AUTH_TOKEN_LEN + 88];
+  snprintf(cookie, sizeof(cookie), HTTP_AUTH_COOKIE "=%s; Max-Age=%d; Path=/; HttpOnly; SameSite=Strict" HTTP_AUTH_COOKIE_SECURE,
+           token, CONFIG_LOCKBOX_AUTH_TOKEN_TTL);
+
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  httpd_resp_set_hdr(req, "Set-Cookie", cookie);
+
+  char json_buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, json_buf, sizeof(json_buf));
+  json_obj_begin(&w);
+  json_kv_str(&w, "token", token);
+  json_kv_int(&w, "expires_in", CONFIG_LOCKBOX_AUTH_TOKEN_TTL);
+  json_obj_end(&w);
+  json_resp_end(&w);
+
+  ESP_LOGI(TAG, "Issued session token");
+  return ESP_OK;
+}
+
+static const httpd_uri_t login_uri = {
+    .uri = "/login",
+    .method = HTTP_POST,
+    .handler = login_post_handler,
+    .user_ctx = NULL};
+
+esp_err_t http_auth_register(httpd_handle_t server)
+{
+  return http_server_register(server, &login_uri);
+}
+
+#else
+
+esp_err_t http_auth_init(const char *username, const char *password)
+{
+  ESP_LOGW(TAG, "Basic auth disabled, API routes are open");
+  return ESP_OK;
+}
+
+esp_err_t http_auth_register(httpd_handle_t server)
+{
+  return ESP_OK;
+}
+
+bool http_auth_valid(httpd_req_t *req)
+{
+  return true;
+}
+
+bool http_auth_check(httpd_req_t *req)
+{
+  return true;
+}
+
+#endif // CONFIG_EXAMPLE_BASIC_AUTH
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* longest Authorization header we accept; anything longer is rejected unread */
+#define HTTP_AUTH_VALUE_MAX (128)
+
+/* cookie carrying the session token issued by POST /login */
+#define HTTP_AUTH_COOKIE "lb_token"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Precompute the expected "Basic ..." authorization value
+ *
+ * Call once before registering handlers. No-op unless CONFIG_EXAMPLE_BASIC_AUTH.
+ *
+ * @return ESP_ERR_INVALID_STATE if @p password is empty; no request authenticates then
+ */
+esp_err_t http_auth_init(const char *username, const char *password);
+
+/**
+ * @brief Register POST /login, which trades basic credentials for a session token
+ *
+ * Tokens are HMAC-SHA256 signed with a key generated at boot and expire after
+ * CONFIG_LOCKBOX_AUTH_TOKEN_TTL seconds. They are returned in the body and as
+ * the HTTP_AUTH_COOKIE cookie.
+ */
+esp_err_t http_auth_register(httpd_handle_t server);
+
+/**
+ * @brief Shared credential check for API handlers
+ *
+ * Accepts "Authorization: Bearer <token>", the session cookie, or basic
+ * credentials. Tokens cost one HMAC and no state lookup; basic credentials are
+ * compared in constant time with the precomputed value. Does no heap
+ * allocation. On failure a 401 has already been sent, and the handler should
+ * just return ESP_OK.
+ *
+ * @return true if the request may proceed
+ */
+bool http_auth_check(httpd_req_t *req);
+
+/**
+ * @brief Same credential check as http_auth_check(), but sends nothing
+ *
+ * For requests that can't carry a 401, such as a WebSocket upgrade that
+ * httpd has already answered with 101.
+ */
+bool http_auth_valid(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,358 @@
+#include "http_metrics.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include <esp_wifi.h>
+#include "wifi_stats.h"
+#include "wifi_power.h"
+#include "wifi_ps.h"
+#endif
+
+#include "metrics.h"
+#include "storage.h"
+#include "http_server.h"
+#include "http_auth.h"
+#include "http_async.h"
+#include "http_arena.h"
+
+static const char *TAG = "http_metrics";
+
+/*
+ * Scrapes only run on the httpd task, one at a time, so the output buffer and
+ * the task snapshot can be static and reused for every scrape.
+ */
+typedef struct
+{
+  httpd_req_t *req;
+  esp_err_t err;
+  size_t len;
+  char buf[CONFIG_LOCKBOX_METRICS_BUFFER];
+} metrics_writer_t;
+
+static metrics_writer_t s_writer;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t s_tasks[CONFIG_LOCKBOX_METRICS_MAX_TASKS];
+#endif
+
+static http_route_stats_t s_routes[HTTP_MAX_ROUTES];
+
+/* --------------------------------- WRITER --------------------------------- */
+
+static void writer_flush(metrics_writer_t *w)
+{
+  if (w->len && w->err == ESP_OK)
+  {
+    w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+  }
+  w->len = 0;
+}
+
+static void emit(metrics_writer_t *w, const char *fmt, ...)
+{
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    size_t room = sizeof(w->buf) - w->len;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, room, fmt, args);
+    va_end(args);
+
+    if (n < 0)
+    {
+      return;
+    }
+    if ((size_t)n < room)
+    {
+      w->len += n;
+      return;
+    }
+
+    // didn't fit: ship what we have and retry into an empty buffer
+    writer_flush(w);
+  }
+
+  ESP_LOGW(TAG, "Metrics line longer than buffer, skipped");
+}
+
+static void emit_type(metrics_writer_t *w, const char *family, const char *type, const char *help)
+{
+  emit(w, "# HELP %s %s\n# TYPE %s %s\n", family, help, family, type);
+}
+
+/* --------------------------------- SECTIONS -------------------------------- */
+
+static void emit_counters(metrics_writer_t *w)
+{
+  const char *family = NULL;
+  for (metric_id_t id = 0; id < METRIC_COUNT; id++)
+  {
+    const metric_info_t *info = metrics_info(id);
+
+    // labelled counters share a family; only announce it once
+    if (!family || strcmp(family, info->family) != 0)
+    {
+      family = info->family;
+      emit_type(w, family, "counter", info->help);
+    }
+    emit(w, "%s%s %" PRIu32 "\n", info->family, info->labels, metrics_get(id));
+  }
+}
+
+static void emit_heap(metrics_writer_t *w)
+{
+  emit_type(w, "lockbox_heap_free_bytes", "gauge", "Free 8-bit capable heap");
+  emit(w, "lockbox_heap_free_bytes %u\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+
+  emit_type(w, "lockbox_heap_largest_free_block_bytes", "gauge", "Largest allocatable 8-bit block");
+  emit(w, "lockbox_heap_largest_free_block_bytes %u\n", (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  emit_type(w, "lockbox_heap_minimum_free_bytes", "gauge", "Lowest free heap since boot");
+  emit(w, "lockbox_heap_minimum_free_bytes %u\n", (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+}
+
+static void emit_storage(metrics_writer_t *w)
+{
+  storage_stats_t stats;
+  storage_get_stats(&stats);
+
+  emit_type(w, "lockbox_nvs_init_seconds", "gauge", "Time NVS init (and any erase) took at boot");
+  emit(w, "lockbox_nvs_init_seconds %" PRIu32 ".%06" PRIu32 "\n", stats.init_us / 1000000, stats.init_us % 1000000);
+  emit_type(w, "lockbox_nvs_erased_at_boot", "gauge", "1 if the NVS partition had to be wiped at boot");
+  emit(w, "lockbox_nvs_erased_at_boot %d\n", stats.erased ? 1 : 0);
+  emit_type(w, "lockbox_nvs_entries", "gauge", "NVS entries by state");
+  emit(w, "lockbox_nvs_entries{state=\"used\"} %u\n", (unsigned)stats.used_entries);
+  emit(w, "lockbox_nvs_entries{state=\"free\"} %u\n", (unsigned)stats.free_entries);
+  emit_type(w, "lockbox_nvs_namespaces", "gauge", "Namespaces in the NVS partition");
+  emit(w, "lockbox_nvs_namespaces %u\n", (unsigned)stats.namespaces);
+  emit_type(w, "lockbox_nvs_open_handles", "gauge", "Namespace handles held by the storage service");
+  emit(w, "lockbox_nvs_open_handles %" PRIu32 "\n", stats.handles);
+
+  emit_type(w, "lockbox_nvs_commits_total", "counter", "Write-behind flushes that reached flash");
+  emit(w, "lockbox_nvs_commits_total %" PRIu32 "\n", stats.commits);
+  emit_type(w, "lockbox_nvs_bytes_written_total", "counter", "Value bytes written by write-behind flushes");
+  emit(w, "lockbox_nvs_bytes_written_total %" PRIu64 "\n", stats.bytes_written);
+  emit_type(w, "lockbox_nvs_coalesced_writes_total", "counter", "Queued writes replaced before reaching flash");
+  emit(w, "lockbox_nvs_coalesced_writes_total %" PRIu32 "\n", stats.coalesced);
+  emit_type(w, "lockbox_nvs_pending_writes", "gauge", "Writes waiting for the next flush");
+  emit(w, "lockbox_nvs_pending_writes %" PRIu32 "\n", stats.pending);
+
+  // rate() needs two scrapes; this one is readable from a single curl
+  uint64_t uptime_s = esp_timer_get_time() / 1000000;
+  emit_type(w, "lockbox_nvs_commits_per_hour", "gauge", "Average commits per hour since boot");
+  emit(w, "lockbox_nvs_commits_per_hour %" PRIu64 "\n", uptime_s ? (uint64_t)stats.commits * 3600 / uptime_s : 0);
+}
+
+static void emit_tasks(metrics_writer_t *w)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  configRUN_TIME_COUNTER_TYPE total = 0;
+  UBaseType_t count = uxTaskGetSystemState(s_tasks, CONFIG_LOCKBOX_METRICS_MAX_TASKS, &total);
+  if (count == 0)
+  {
+    ESP_LOGW(TAG, "More than %d tasks, raise LOCKBOX_METRICS_MAX_TASKS", CONFIG_LOCKBOX_METRICS_MAX_TASKS);
+    return;
+  }
+
+  emit_type(w, "lockbox_task_stack_high_water_bytes", "gauge", "Least free stack a task has had");
+  for (UBaseType_t i = 0; i < count; i++)
+  {
+    emit(w, "lockbox_task_stack_high_water_bytes{task=\"%s\"} %u\n",
+         s_tasks[i].pcTaskName, (unsigned)s_tasks[i].usStackHighWaterMark);
+  }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_RUN_TIME_COUNTER_TYPE_U64
+  // run time counters tick in µs (esp_timer clock); rate() of this is the CPU share.
+  // A 32-bit counter wraps every 71 minutes, which a counter must never do
+  emit_type(w, "lockbox_task_cpu_seconds_total", "counter", "CPU time consumed by a task");
+  for (UBaseType_t i = 0; i < count; i++)
+  {
+    uint64_t us = s_tasks[i].ulRunTimeCounter;
+    emit(w, "lockbox_task_cpu_seconds_total{task=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+         s_tasks[i].pcTaskName, us / 1000000, us % 1000000);
+  }
+#elif CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#warning "FREERTOS_RUN_TIME_COUNTER_TYPE_U64 is off, task CPU time is not exported"
+#endif
+#endif
+}
+
+static void emit_wifi(metrics_writer_t *w)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+  {
+    emit_type(w, "lockbox_wifi_rssi_dbm", "gauge", "Signal strength of the current AP");
+    emit(w, "lockbox_wifi_rssi_dbm %d\n", ap.rssi);
+  }
+
+  wifi_stats_t stats;
+  wifi_get_stats(&stats);
+
+  emit_type(w, "lockbox_wifi_last_connect_seconds", "gauge", "Connect start to IP address for the latest connection");
+  emit(w, "lockbox_wifi_last_connect_seconds %" PRIu32 ".%03" PRIu32 "\n",
+       stats.last_connect_ms / 1000, stats.last_connect_ms % 1000);
+  emit_type(w, "lockbox_wifi_last_connect_fast", "gauge", "1 if the latest connection reused the cached AP");
+  emit(w, "lockbox_wifi_last_connect_fast %d\n", stats.last_connect_fast ? 1 : 0);
+  emit_type(w, "lockbox_wifi_connects_total", "counter", "Connections by how the AP was found");
+  emit(w, "lockbox_wifi_connects_total{path=\"cached\"} %" PRIu32 "\n", stats.fast_connects);
+  emit(w, "lockbox_wifi_connects_total{path=\"scan\"} %" PRIu32 "\n", stats.scan_connects);
+
+  emit_type(w, "lockbox_wifi_disconnects_total", "counter", "Established links lost");
+  emit(w, "lockbox_wifi_disconnects_total %" PRIu32 "\n", stats.disconnects);
+  emit_type(w, "lockbox_wifi_reconnect_delay_seconds", "gauge", "Backoff before the pending reconnect attempt");
+  emit(w, "lockbox_wifi_reconnect_delay_seconds %" PRIu32 ".%03" PRIu32 "\n",
+       stats.reconnect_delay_ms / 1000, stats.reconnect_delay_ms % 1000);
+  emit_type(w, "lockbox_wifi_offline_seconds", "gauge", "Length of the current outage, 0 while connected");
+  emit(w, "lockbox_wifi_offline_seconds %" PRIu32 ".%03" PRIu32 "\n",
+       stats.offline_ms / 1000, stats.offline_ms % 1000);
+  emit_type(w, "lockbox_wifi_offline_seconds_total", "counter", "Time spent offline in completed outages");
+  emit(w, "lockbox_wifi_offline_seconds_total %" PRIu64 ".%03" PRIu64 "\n",
+       stats.offline_ms_total / 1000, stats.offline_ms_total % 1000);
+
+  emit_type(w, "lockbox_wifi_scans_total", "counter", "Scans started to pick or roam to an AP");
+  emit(w, "lockbox_wifi_scans_total %" PRIu32 "\n", stats.scans);
+  emit_type(w, "lockbox_wifi_roam_attempts_total", "counter", "Times the signal fell below the roam threshold");
+  emit(w, "lockbox_wifi_roam_attempts_total %" PRIu32 "\n", stats.roam_attempts);
+  emit_type(w, "lockbox_wifi_roams_total", "counter", "Moves to a stronger AP");
+  emit(w, "lockbox_wifi_roams_total %" PRIu32 "\n", stats.roams);
+
+  wifi_ps_type_t mode;
+  uint16_t listen_interval;
+  wifi_power_get(&mode, &listen_interval);
+  emit_type(w, "lockbox_wifi_power_save_info", "gauge", "Active power save mode and listen interval");
+  emit(w, "lockbox_wifi_power_save_info{mode=\"%s\",listen_interval=\"%u\"} 1\n",
+       wifi_power_name(mode), listen_interval);
+
+  wifi_ps_stats_t ps[WIFI_PS_MODES];
+  if (wifi_ps_get_stats(ps))
+  {
+    emit_type(w, "lockbox_wifi_ps_probe_rtt_seconds_total", "counter", "Gateway round trips per power save mode");
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+      emit(w, "lockbox_wifi_ps_probe_rtt_seconds_total{mode=\"%s\"} %" PRIu64 ".%03" PRIu64 "\n",
+           wifi_power_name((wifi_ps_type_t)i), ps[i].rtt_sum_ms / 1000, ps[i].rtt_sum_ms % 1000);
+    }
+    emit_type(w, "lockbox_wifi_ps_probes_total", "counter", "Gateway probes per power save mode and outcome");
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+      emit(w, "lockbox_wifi_ps_probes_total{mode=\"%s\",result=\"reply\"} %" PRIu32 "\n",
+           wifi_power_name((wifi_ps_type_t)i), ps[i].probes);
+      emit(w, "lockbox_wifi_ps_probes_total{mode=\"%s\",result=\"lost\"} %" PRIu32 "\n",
+           wifi_power_name((wifi_ps_type_t)i), ps[i].lost);
+    }
+    emit_type(w, "lockbox_wifi_ps_mode_seconds_total", "counter", "Wall-clock time in each power save mode while measuring; radio-on time is not measured");
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+      emit(w, "lockbox_wifi_ps_mode_seconds_total{mode=\"%s\"} %" PRIu64 ".%03" PRIu64 "\n",
+           wifi_power_name((wifi_ps_type_t)i), ps[i].in_mode_ms / 1000, ps[i].in_mode_ms % 1000);
+    }
+  }
+#endif
+}
+
+static void emit_http(metrics_writer_t *w)
+{
+  size_t routes = http_server_route_stats(s_routes, HTTP_MAX_ROUTES);
+
+  emit_type(w, "lockbox_http_requests_total", "counter", "Requests dispatched per route");
+  for (size_t i = 0; i < routes; i++)
+  {
+    emit(w, "lockbox_http_requests_total{method=\"%s\",uri=\"%s\"} %" PRIu32 "\n",
+         http_method_str(s_routes[i].method), s_routes[i].uri, s_routes[i].requests);
+  }
+
+  uint32_t counts[HTTP_LATENCY_BUCKETS];
+  uint64_t sum_us;
+  http_server_latency_stats(counts, &sum_us);
+
+  emit_type(w, "lockbox_http_request_duration_seconds", "histogram", "Time spent in handlers on the httpd task");
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < HTTP_LATENCY_BUCKETS - 1; i++)
+  {
+    cumulative += counts[i];
+    uint32_t le = http_latency_bounds_us[i];
+    emit(w, "lockbox_http_request_duration_seconds_bucket{le=\"%" PRIu32 ".%06" PRIu32 "\"} %" PRIu32 "\n",
+         le / 1000000, le % 1000000, cumulative);
+  }
+  cumulative += counts[HTTP_LATENCY_BUCKETS - 1];
+  emit(w, "lockbox_http_request_duration_seconds_bucket{le=\"+Inf\"} %" PRIu32 "\n", cumulative);
+  emit(w, "lockbox_http_request_duration_seconds_sum %" PRIu64 ".%06" PRIu64 "\n", sum_us / 1000000, sum_us % 1000000);
+  emit(w, "lockbox_http_request_duration_seconds_count %" PRIu32 "\n", cumulative);
+
+  http_async_stats_t async;
+  http_async_get_stats(&async);
+
+  emit_type(w, "lockbox_http_async_queue_depth", "gauge", "Slow requests waiting for or running on a worker");
+  emit(w, "lockbox_http_async_queue_depth %" PRIu32 "\n", async.queued + async.active);
+  emit_type(w, "lockbox_http_async_queue_peak", "gauge", "Highest async queue depth since boot");
+  emit(w, "lockbox_http_async_queue_peak %" PRIu32 "\n", async.peak);
+  emit_type(w, "lockbox_http_async_rejected_total", "counter", "Slow requests refused with 503 because the queue was full");
+  emit(w, "lockbox_http_async_rejected_total %" PRIu32 "\n", async.rejected);
+
+  http_arena_stats_t arena;
+  http_arena_get_stats(&arena);
+
+  emit_type(w, "lockbox_http_arena_in_use", "gauge", "Request scratch arenas currently held");
+  emit(w, "lockbox_http_arena_in_use %" PRIu32 "\n", arena.in_use);
+  emit_type(w, "lockbox_http_arena_peak", "gauge", "Most request scratch arenas held at once since boot");
+  emit(w, "lockbox_http_arena_peak %" PRIu32 "\n", arena.peak);
+  emit_type(w, "lockbox_http_arena_high_water_bytes", "gauge", "Most scratch bytes used by one request");
+  emit(w, "lockbox_http_arena_high_water_bytes %" PRIu32 "\n", arena.high_water);
+  emit_type(w, "lockbox_http_arena_exhausted_total", "counter", "Scratch allocations refused because the pool or an arena was full");
+  emit(w, "lockbox_http_arena_exhausted_total %" PRIu32 "\n", arena.exhausted);
+}
+
+/* --------------------------------- HANDLER -------------------------------- */
+
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  metrics_writer_t *w = &s_writer;
+  w->req = req;
+  w->err = ESP_OK;
+  w->len = 0;
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  emit_counters(w);
+  emit_heap(w);
+  emit_storage(w);
+  emit_tasks(w);
+  emit_wifi(w);
+  emit_http(w);
+
+  writer_flush(w);
+  if (w->err != ESP_OK)
+  {
+    return w->err;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static const httpd_uri_t metrics_uri = {
+    .uri = "/metrics",
+    .method = HTTP_GET,
+    .handler = metrics_get_handler,
+    .user_ctx = NULL};
+
+esp_err_t http_metrics_register(httpd_handle_t server)
+{
+  return http_server_register(server, &metrics_uri);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register GET /metrics (Prometheus text format)
+ *
+ * Output is rendered into a preallocated buffer and streamed with
+ * httpd_resp_send_chunk() whenever it fills up, so a scrape does no heap
+ * allocation regardless of how many tasks or routes there are.
+ */
+esp_err_t http_metrics_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
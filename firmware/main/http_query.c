@@ -0,0 +1,99 @@
+#include "http_query.h"
+
+#include <string.h>
+
+#include "protocol_examples_utils.h"
+
+void http_query_parse(http_query_t *q, const char *data, size_t len)
+{
+  q->count = 0;
+  q->truncated = false;
+
+  const char *p = data;
+  const char *end = data + len;
+
+  while (p < end)
+  {
+    const char *amp = memchr(p, '&', end - p);
+    const char *pair_end = amp ? amp : end;
+
+    // empty pairs ("a=1&&b=2") carry nothing
+    if (pair_end > p)
+    {
+      if (q->count == HTTP_QUERY_MAX_PARAMS)
+      {
+        q->truncated = true;
+        return;
+      }
+
+      http_query_param_t *param = &q->params[q->count++];
+      const char *eq = memchr(p, '=', pair_end - p);
+
+      param->key.ptr = p;
+      param->key.len = (eq ? eq : pair_end) - p;
+      param->value.ptr = eq ? eq + 1 : pair_end;
+      param->value.len = eq ? pair_end - (eq + 1) : 0;
+    }
+
+    p = pair_end + 1;
+  }
+}
+
+void http_query_parse_req(http_query_t *q, httpd_req_t *req)
+{
+  // req->uri already holds the query; no need to copy it out first
+  const char *query = strchr(req->uri, '?');
+  if (!query)
+  {
+    q->count = 0;
+    q->truncated = false;
+    return;
+  }
+
+  query++;
+  const char *fragment = strchr(query, '#');
+  http_query_parse(q, query, fragment ? (size_t)(fragment - query) : strlen(query));
+}
+
+const http_str_t *http_query_get(const http_query_t *q, const char *key)
+{
+  size_t key_len = strlen(key);
+  for (size_t i = 0; i < q->count; i++)
+  {
+    const http_str_t *k = &q->params[i].key;
+    if (k->len == key_len && memcmp(k->ptr, key, key_len) == 0)
+    {
+      return &q->params[i].value;
+    }
+  }
+  return NULL;
+}
+
+esp_err_t http_query_decode(const http_str_t *value, char *dst, size_t size)
+{
+  if (size == 0)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  // decoding never grows a value, so only a long raw one needs measuring first
+  if (value->len >= size && example_uri_decode_arg(NULL, value->ptr, value->len) >= size)
+  {
+    dst[0] = '\0';
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  size_t n = example_uri_decode_arg(dst, value->ptr, value->len);
+  dst[n] = '\0';
+  return ESP_OK;
+}
+
+esp_err_t http_query_value(const http_query_t *q, const char *key, char *dst, size_t size)
+{
+  const http_str_t *value = http_query_get(q, key);
+  if (!value)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return http_query_decode(value, dst, size);
+}
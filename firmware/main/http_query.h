@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* parameters kept per query; later ones are dropped and flagged */
+#define HTTP_QUERY_MAX_PARAMS (8)
+
+/** @brief Non-owning view into a request buffer, not NUL-terminated */
+typedef struct
+{
+  const char *ptr;
+  size_t len;
+} http_str_t;
+
+typedef struct
+{
+  http_str_t key;   // raw, still percent-encoded
+  http_str_t value; // raw, still percent-encoded; len 0 for "key" and "key="
+} http_query_param_t;
+
+typedef struct
+{
+  http_query_param_t params[HTTP_QUERY_MAX_PARAMS];
+  size_t count;
+  bool truncated; // more than HTTP_QUERY_MAX_PARAMS parameters
+} http_query_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Split "a=1&b=2" into key/value views in one pass
+ *
+ * Nothing is copied or decoded: the views point into @p data, which must
+ * outlive @p q. Works for URL queries and form-encoded bodies alike.
+ */
+void http_query_parse(http_query_t *q, const char *data, size_t len);
+
+/** @brief Parse the query part of the request URI in place (empty if there is none) */
+void http_query_parse_req(http_query_t *q, httpd_req_t *req);
+
+/** @brief Raw value of the first parameter whose raw key equals @p key, or NULL */
+const http_str_t *http_query_get(const http_query_t *q, const char *key);
+
+/**
+ * @brief Percent- and '+'-decode a view into @p dst, NUL-terminated
+ *
+ * Decoding only happens here, so untouched parameters cost nothing. Escapes
+ * follow example_uri_decode_arg(), the same nginx rules as URI decoding.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the result doesn't fit (dst is left empty)
+ */
+esp_err_t http_query_decode(const http_str_t *value, char *dst, size_t size);
+
+/** @brief http_query_get() + http_query_decode(); ESP_ERR_NOT_FOUND if the key is absent */
+esp_err_t http_query_value(const http_query_t *q, const char *key, char *dst, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,131 @@
+#include "http_ratelimit.h"
+
+#include <string.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#else
+#include <lwip/sockets.h>
+#endif
+
+#include "metrics.h"
+
+#if CONFIG_LOCKBOX_RATE_LIMIT
+
+static const char *TAG = "http_ratelimit";
+
+/* buckets count in thousandths of a request, so slow refills don't round to zero */
+#define MILLI (1000)
+#define BUCKET_MAX ((uint32_t)CONFIG_LOCKBOX_RATE_LIMIT_BURST * MILLI)
+
+typedef struct
+{
+  uint8_t addr[16]; // IPv6, or IPv4-mapped
+  uint32_t tokens;
+  int64_t last_us;  // last refill, also the LRU age
+  bool used;
+} rate_bucket_t;
+
+/* only the httpd task touches the table, so no lock */
+static rate_bucket_t s_buckets[CONFIG_LOCKBOX_RATE_LIMIT_CLIENTS];
+
+static bool peer_addr(httpd_req_t *req, uint8_t addr[16])
+{
+  struct sockaddr_in6 peer;
+  socklen_t len = sizeof(peer);
+  if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&peer, &len) != 0)
+  {
+    return false;
+  }
+
+  if (peer.sin6_family == AF_INET)
+  {
+    // map to ::ffff:a.b.c.d so both families share one key format
+    memset(addr, 0, 10);
+    addr[10] = addr[11] = 0xff;
+    memcpy(addr + 12, &((struct sockaddr_in *)&peer)->sin_addr, 4);
+  }
+  else
+  {
+    memcpy(addr, &peer.sin6_addr, 16);
+  }
+  return true;
+}
+
+static rate_bucket_t *lookup(const uint8_t addr[16], int64_t now)
+{
+  rate_bucket_t *oldest = &s_buckets[0];
+  for (size_t i = 0; i < CONFIG_LOCKBOX_RATE_LIMIT_CLIENTS; i++)
+  {
+    rate_bucket_t *b = &s_buckets[i];
+    if (b->used && memcmp(b->addr, addr, 16) == 0)
+    {
+      return b;
+    }
+    // free slots count as oldest of all
+    if (!b->used || (oldest->used && b->last_us < oldest->last_us))
+    {
+      oldest = b;
+    }
+  }
+
+  if (oldest->used)
+  {
+    metrics_inc(METRIC_HTTP_RATE_LIMIT_EVICTIONS);
+  }
+  memcpy(oldest->addr, addr, 16);
+  oldest->tokens = BUCKET_MAX;
+  oldest->last_us = now;
+  oldest->used = true;
+  return oldest;
+}
+
+bool http_ratelimit_allow(httpd_req_t *req)
+{
+#if CONFIG_HTTPD_WS_SUPPORT
+  // frames on an open WebSocket aren't requests; the upgrade itself was counted
+  if (httpd_ws_get_fd_info(req->handle, httpd_req_to_sockfd(req)) == HTTPD_WS_CLIENT_WEBSOCKET)
+  {
+    return true;
+  }
+#endif
+
+  uint8_t addr[16];
+  if (!peer_addr(req, addr))
+  {
+    return true;
+  }
+
+  int64_t now = esp_timer_get_time();
+  rate_bucket_t *b = lookup(addr, now);
+
+  uint64_t refill = (uint64_t)(now - b->last_us) * CONFIG_LOCKBOX_RATE_LIMIT_RPS * MILLI / 1000000;
+  b->tokens = refill >= BUCKET_MAX - b->tokens ? BUCKET_MAX : b->tokens + (uint32_t)refill;
+  b->last_us = now;
+
+  if (b->tokens >= MILLI)
+  {
+    b->tokens -= MILLI;
+    return true;
+  }
+
+  metrics_inc(METRIC_HTTP_THROTTLED);
+  ESP_LOGD(TAG, "Throttled %s %s", http_method_str(req->method), req->uri);
+
+  httpd_resp_set_status(req, "429 Too Many Requests");
+  httpd_resp_set_hdr(req, "Retry-After", "1");
+  httpd_resp_send(req, NULL, 0);
+  return false;
+}
+
+#else
+
+bool http_ratelimit_allow(httpd_req_t *req)
+{
+  return true;
+}
+
+#endif // CONFIG_LOCKBOX_RATE_LIMIT
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Take one token from the bucket of the client behind @p req
+ *
+ * Buckets live in a fixed table keyed by peer address, evicting the least
+ * recently seen client when full. Only call from the httpd task.
+ *
+ * @return false if the client is over its limit; a 429 has then been sent
+ */
+bool http_ratelimit_allow(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
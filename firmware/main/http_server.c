@@ -1,161 +1,199 @@
 #include "http_server.h"
 
+#include <stdatomic.h>
+#if CONFIG_LOCKBOX_HTTPS
+#include <esp_https_server.h>
+#include <mbedtls/ssl_ciphersuites.h>
+#endif
+
+#include "event_stream.h"
+#include "ws_admin.h"
+#include "http_auth.h"
+#include "http_async.h"
+#include "lockbox_api.h"
+#include "http_metrics.h"
+#include "status.h"
+#include "json_writer.h"
+#include "http_arena.h"
+#include "credentials.h"
+#include "http_ratelimit.h"
+#include "http_query.h"
+#include "settings.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim.h"
+#else
+#include "wifi_ps.h"
+#endif
+
 static const char *TAG = "http_server";
 
-#if CONFIG_EXAMPLE_BASIC_AUTH
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+/* --------------------------------- ROUTES --------------------------------- */
 
 typedef struct
 {
-  char *username;
-  char *password;
-} basic_auth_info_t;
+  httpd_uri_t uri; // copy handed to httpd, with handler/user_ctx pointing at the dispatcher
+  esp_err_t (*handler)(httpd_req_t *req);
+  void *user_ctx;
+  atomic_uint requests;
+} http_route_t;
 
-#define HTTPD_401 "401 UNAUTHORIZED" /*!< HTTP Response 401 */
+const uint32_t http_latency_bounds_us[HTTP_LATENCY_BUCKETS - 1] = {1000, 5000, 10000, 50000, 100000, 500000};
 
-static char *http_auth_basic(const char *username, const char *password)
+static http_route_t s_routes[HTTP_MAX_ROUTES];
+static size_t s_route_count = 0;
+
+/* histogram is only written from the httpd task */
+static uint32_t s_latency_counts[HTTP_LATENCY_BUCKETS];
+static uint64_t s_latency_sum_us = 0;
+
+static esp_err_t route_dispatch(httpd_req_t *req)
 {
-  size_t out;
-  char *user_info = NULL;
-  char *digest = NULL;
-  size_t n = 0;
-  int rc = asprintf(&user_info, "%s:%s", username, password);
-  if (rc < 0)
+  http_route_t *route = (http_route_t *)req->user_ctx;
+
+  // give the real handler its own context back
+  req->user_ctx = route->user_ctx;
+  atomic_fetch_add(&route->requests, 1);
+
+  // over-limit clients are answered here, before any handler work
+  if (!http_ratelimit_allow(req))
   {
-    ESP_LOGE(TAG, "asprintf() returned: %d", rc);
-    return NULL;
+    return ESP_OK;
   }
 
-  if (!user_info)
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = route->handler(req);
+  http_arena_release(req);
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+  size_t bucket = 0;
+  while (bucket < HTTP_LATENCY_BUCKETS - 1 && elapsed > http_latency_bounds_us[bucket])
   {
-    ESP_LOGE(TAG, "No enough memory for user information");
-    return NULL;
+    bucket++;
   }
-  esp_crypto_base64_encode(NULL, 0, &n, (const unsigned char *)user_info, strlen(user_info));
-
-  /* 6: The length of the "Basic " string
-   * n: Number of bytes for a base64 encode format
-   * 1: Number of bytes for a reserved which be used to fill zero
-   */
-  digest = calloc(1, 6 + n + 1);
-  if (digest)
+  s_latency_counts[bucket]++;
+  s_latency_sum_us += elapsed;
+
+  return err;
+}
+
+esp_err_t http_server_register(httpd_handle_t server, const httpd_uri_t *uri)
+{
+  if (s_route_count == HTTP_MAX_ROUTES)
+  {
+    ESP_LOGE(TAG, "Route table full, can't register %s", uri->uri);
+    return ESP_ERR_NO_MEM;
+  }
+
+  http_route_t *route = &s_routes[s_route_count];
+  route->uri = *uri;
+  route->handler = uri->handler;
+  route->user_ctx = uri->user_ctx;
+  atomic_store(&route->requests, 0);
+
+  route->uri.handler = route_dispatch;
+  route->uri.user_ctx = route;
+
+  esp_err_t err = httpd_register_uri_handler(server, &route->uri);
+  if (err == ESP_OK)
   {
-    strcpy(digest, "Basic ");
-    esp_crypto_base64_encode((unsigned char *)digest + 6, n, &out, (const unsigned char *)user_info, strlen(user_info));
+    s_route_count++;
   }
-  free(user_info);
-  return digest;
+  return err;
 }
 
-/* An HTTP GET handler */
-static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+size_t http_server_route_stats(http_route_stats_t *stats, size_t max)
 {
-  char *buf = NULL;
-  size_t buf_len = 0;
-  basic_auth_info_t *basic_auth_info = req->user_ctx;
-
-  buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-  if (buf_len > 1)
+  size_t n = s_route_count < max ? s_route_count : max;
+  for (size_t i = 0; i < n; i++)
   {
-    buf = calloc(1, buf_len);
-    if (!buf)
-    {
-      ESP_LOGE(TAG, "No enough memory for basic authorization");
-      return ESP_ERR_NO_MEM;
-    }
+    stats[i].uri = s_routes[i].uri.uri;
+    stats[i].method = s_routes[i].uri.method;
+    stats[i].requests = atomic_load(&s_routes[i].requests);
+  }
+  return n;
+}
 
-    if (httpd_req_get_hdr_value_str(req, "Authorization", buf, buf_len) == ESP_OK)
-    {
-      ESP_LOGI(TAG, "Found header => Authorization: %s", buf);
-    }
-    else
-    {
-      ESP_LOGE(TAG, "No auth value received");
-    }
+void http_server_latency_stats(uint32_t counts[HTTP_LATENCY_BUCKETS], uint64_t *sum_us)
+{
+  memcpy(counts, s_latency_counts, sizeof(s_latency_counts));
+  *sum_us = s_latency_sum_us;
+}
 
-    char *auth_credentials = http_auth_basic(basic_auth_info->username, basic_auth_info->password);
-    if (!auth_credentials)
-    {
-      ESP_LOGE(TAG, "No enough memory for basic authorization credentials");
-      free(buf);
-      return ESP_ERR_NO_MEM;
-    }
+#if CONFIG_EXAMPLE_BASIC_AUTH
 
-    if (strncmp(auth_credentials, buf, buf_len))
-    {
-      ESP_LOGE(TAG, "Not authenticated");
-      httpd_resp_set_status(req, HTTPD_401);
-      httpd_resp_set_type(req, "application/json");
-      httpd_resp_set_hdr(req, "Connection", "keep-alive");
-      httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Hello\"");
-      httpd_resp_send(req, NULL, 0);
-    }
-    else
-    {
-      ESP_LOGI(TAG, "Authenticated!");
-      char *basic_auth_resp = NULL;
-      httpd_resp_set_status(req, HTTPD_200);
-      httpd_resp_set_type(req, "application/json");
-      httpd_resp_set_hdr(req, "Connection", "keep-alive");
-      int rc = asprintf(&basic_auth_resp, "{\"authenticated\": true,\"user\": \"%s\"}", basic_auth_info->username);
-      if (rc < 0)
-      {
-        ESP_LOGE(TAG, "asprintf() returned: %d", rc);
-        free(auth_credentials);
-        return ESP_FAIL;
-      }
-      if (!basic_auth_resp)
-      {
-        ESP_LOGE(TAG, "No enough memory for basic authorization response");
-        free(auth_credentials);
-        free(buf);
-        return ESP_ERR_NO_MEM;
-      }
-      httpd_resp_send(req, basic_auth_resp, strlen(basic_auth_resp));
-      free(basic_auth_resp);
-    }
-    free(auth_credentials);
-    free(buf);
-  }
-  else
+/* An HTTP GET handler */
+static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
   {
-    ESP_LOGE(TAG, "No auth header received");
-    httpd_resp_set_status(req, HTTPD_401);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Hello\"");
-    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
   }
 
-  return ESP_OK;
+  const char *username = (const char *)req->user_ctx;
+
+  httpd_resp_set_status(req, HTTPD_200);
+  httpd_resp_set_hdr(req, "Connection", "keep-alive");
+
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_bool(&w, "authenticated", true);
+  json_kv_str(&w, "user", username);
+  json_obj_end(&w);
+  return json_resp_end(&w);
 }
 
-static httpd_uri_t basic_auth = {
+static const httpd_uri_t basic_auth = {
     .uri = "/basic_auth",
     .method = HTTP_GET,
     .handler = basic_auth_get_handler,
+    .user_ctx = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME,
 };
+#endif
+
+/* -------------------------------- HANDLERS -------------------------------- */
 
-static void httpd_register_basic_auth(httpd_handle_t server)
+/* gzipped dashboard embedded by main/CMakeLists.txt; lives in memory-mapped flash */
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+
+/* strong validator for the embedded page, computed once in start_webserver() */
+static char s_index_etag[20];
+
+static void index_etag_init(void)
 {
-  basic_auth_info_t *basic_auth_info = calloc(1, sizeof(basic_auth_info_t));
-  if (basic_auth_info)
+  // FNV-1a over the compressed bytes; changes whenever the page does
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const uint8_t *p = index_html_gz_start; p < index_html_gz_end; p++)
   {
-    basic_auth_info->username = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME;
-    basic_auth_info->password = CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD;
-
-    basic_auth.user_ctx = basic_auth_info;
-    httpd_register_uri_handler(server, &basic_auth);
+    hash = (hash ^ *p) * 0x100000001b3ULL;
   }
+  snprintf(s_index_etag, sizeof(s_index_etag), "\"%016" PRIx64 "\"", hash);
 }
-#endif
-
-/* -------------------------------- HANDLERS -------------------------------- */
 
 esp_err_t root_get_handler(httpd_req_t *req)
 {
-  httpd_resp_send(req, "Welcome to LockBox.", HTTPD_RESP_USE_STRLEN);
+  char if_none_match[sizeof(s_index_etag)];
 
-  return ESP_OK;
+  httpd_resp_set_hdr(req, "ETag", s_index_etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=" STR(CONFIG_LOCKBOX_WWW_MAX_AGE));
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+      strcmp(if_none_match, s_index_etag) == 0)
+  {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  // the body is sent straight from the flash mapping, never copied to RAM first
+  httpd_resp_set_type(req, "text/html");
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char *)index_html_gz_start, index_html_gz_end - index_html_gz_start);
 }
 
 const httpd_uri_t root_get_uri = {
@@ -168,15 +206,82 @@ const httpd_uri_t root_get_uri = {
 /* -------------------------------------------------------------------------- */
 /*                                PASSCODE API                                */
 /* -------------------------------------------------------------------------- */
-esp_err_t passcode_set_secret_handler(httpd_req_t *req)
+/* Runs on an async worker: verifying and committing to NVS can take a while */
+static esp_err_t passcode_set_secret_work(httpd_req_t *req)
 {
-  // get old passcode from request
+  char body[64] = {0};
+  char old_secret[16] = {0};
+  char new_secret[16] = {0};
+
+  if (req->content_len >= sizeof(body))
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+  }
+
+  // get old and new passcode from request (form encoded: old=1234&new=5678)
+  size_t received = 0;
+  while (received < req->content_len)
+  {
+    int ret = httpd_req_recv(req, body + received, req->content_len - received);
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+      continue;
+    }
+    if (ret <= 0)
+    {
+      return ESP_FAIL;
+    }
+    received += ret;
+  }
+
+  http_query_t form;
+  http_query_parse(&form, body, received);
+  if (http_query_value(&form, "new", new_secret, sizeof(new_secret)) != ESP_OK)
+  {
+    memset(body, 0, sizeof(body));
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing new passcode");
+  }
+  http_query_value(&form, "old", old_secret, sizeof(old_secret));
+  memset(body, 0, sizeof(body));
 
-  // verify validity of old passcode
+  // verify validity of old passcode (not needed until one has been set)
+  esp_err_t err = lockbox_verify_secret(old_secret);
+  memset(old_secret, 0, sizeof(old_secret));
+  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+  {
+    memset(new_secret, 0, sizeof(new_secret));
+    return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Old passcode does not match");
+  }
 
   // set new passcode
+  err = lockbox_set_secret(new_secret);
+  memset(new_secret, 0, sizeof(new_secret));
+  if (err == ESP_FAIL)
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid new passcode");
+  }
+  if (err != ESP_OK)
+  {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store new passcode");
+  }
 
-  return ESP_OK;
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_bool(&w, "updated", true);
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+esp_err_t passcode_set_secret_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  return http_async_submit(req, passcode_set_secret_work);
 }
 
 const httpd_uri_t passcode_set_secret_uri = {
@@ -187,56 +292,46 @@ const httpd_uri_t passcode_set_secret_uri = {
 
 esp_err_t hello_get_handler(httpd_req_t *req)
 {
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
   char *buf;
   size_t buf_len;
 
-  /* Get header value string length and allocate memory for length + 1,
-   * extra byte for null termination */
+  /* Get header value string length and take length + 1 bytes of request
+   * scratch, extra byte for null termination; released after the handler */
   buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
   if (buf_len > 1)
   {
-    buf = malloc(buf_len);
+    buf = http_arena_alloc(req, buf_len);
     ESP_RETURN_ON_FALSE(buf, ESP_ERR_NO_MEM, TAG, "buffer alloc failed");
     /* Copy null terminated value string into buffer */
     if (httpd_req_get_hdr_value_str(req, "Host", buf, buf_len) == ESP_OK)
     {
       ESP_LOGI(TAG, "Found header => Host: %s", buf);
     }
-    free(buf);
   }
 
-  /* Read URL query string length and allocate memory for length + 1,
-   * extra byte for null termination */
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1)
+  /* Tokenize the query once, straight out of req->uri; values are only
+   * decoded when looked up */
+  http_query_t query;
+  http_query_parse_req(&query, req);
+  if (query.count > 0)
   {
-    buf = malloc(buf_len);
-    ESP_RETURN_ON_FALSE(buf, ESP_ERR_NO_MEM, TAG, "buffer alloc failed");
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK)
+    static const char *const keys[] = {"query1", "query3", "query2"};
+    char dec_param[HTTP_QUERY_KEY_MAX_LEN];
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
     {
-      ESP_LOGI(TAG, "Found URL query => %s", buf);
-      char param[HTTP_QUERY_KEY_MAX_LEN], dec_param[HTTP_QUERY_KEY_MAX_LEN] = {0};
-      /* Get value of expected key from query string */
-      if (httpd_query_key_value(buf, "query1", param, sizeof(param)) == ESP_OK)
-      {
-        ESP_LOGI(TAG, "Found URL query parameter => query1=%s", param);
-        example_uri_decode(dec_param, param, strnlen(param, HTTP_QUERY_KEY_MAX_LEN));
-        ESP_LOGI(TAG, "Decoded query parameter => %s", dec_param);
-      }
-      if (httpd_query_key_value(buf, "query3", param, sizeof(param)) == ESP_OK)
+      const http_str_t *param = http_query_get(&query, keys[i]);
+      if (param)
       {
-        ESP_LOGI(TAG, "Found URL query parameter => query3=%s", param);
-        example_uri_decode(dec_param, param, strnlen(param, HTTP_QUERY_KEY_MAX_LEN));
-        ESP_LOGI(TAG, "Decoded query parameter => %s", dec_param);
-      }
-      if (httpd_query_key_value(buf, "query2", param, sizeof(param)) == ESP_OK)
-      {
-        ESP_LOGI(TAG, "Found URL query parameter => query2=%s", param);
-        example_uri_decode(dec_param, param, strnlen(param, HTTP_QUERY_KEY_MAX_LEN));
+        ESP_LOGI(TAG, "Found URL query parameter => %s=%.*s", keys[i], (int)param->len, param->ptr);
+        http_query_decode(param, dec_param, sizeof(dec_param));
         ESP_LOGI(TAG, "Decoded query parameter => %s", dec_param);
       }
     }
-    free(buf);
   }
 
   /* Set some custom headers */
@@ -260,6 +355,11 @@ const httpd_uri_t hello = {
 /* An HTTP POST handler */
 esp_err_t echo_post_handler(httpd_req_t *req)
 {
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
   char buf[100];
   int ret, remaining = req->content_len;
 
@@ -310,66 +410,205 @@ esp_err_t http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
   return ESP_OK;
 }
 
+/* --------------------------------- SERVER --------------------------------- */
+
+#if CONFIG_LOCKBOX_HTTPS
+extern const uint8_t servercert_pem_start[] asm("_binary_servercert_pem_start");
+extern const uint8_t servercert_pem_end[] asm("_binary_servercert_pem_end");
+extern const uint8_t prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const uint8_t prvtkey_pem_end[] asm("_binary_prvtkey_pem_end");
+
+/* ECDHE-ECDSA only, GCM first: AES runs on the hardware block, P-256 keeps the handshake short */
+static const int s_ciphersuites[] = {
+#if CONFIG_MBEDTLS_SSL_PROTO_TLS1_3
+    MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+#endif
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    0};
+#endif
+
+/* httpd keeps three sockets of the lwIP budget for itself (listener + control) */
+#define HTTPD_INTERNAL_SOCKETS (3)
+
+/* one dashboard at once: its event stream, its admin channel and a plain request */
 #if CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
-/* An HTTP GET handler for SSE */
-static esp_err_t sse_handler(httpd_req_t *req)
+#define HTTPD_EVENTS_SOCKETS (1)
+#else
+#define HTTPD_EVENTS_SOCKETS (0)
+#endif
+#if CONFIG_LOCKBOX_WS_ADMIN
+#define HTTPD_WS_SOCKETS (1)
+#else
+#define HTTPD_WS_SOCKETS (0)
+#endif
+#define HTTPD_DASHBOARD_SOCKETS (HTTPD_EVENTS_SOCKETS + HTTPD_WS_SOCKETS + 1)
+
+static const char *apply_profile(httpd_config_t *config)
 {
-  httpd_resp_set_type(req, "text/event-stream");
-  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
-  httpd_resp_set_hdr(req, "Connection", "keep-alive");
+  config->lru_purge_enable = true;
+  config->max_uri_handlers = HTTP_MAX_ROUTES;
+
+#if CONFIG_LOCKBOX_HTTPD_PROFILE_LOW_MEMORY
+  config->max_open_sockets = HTTPD_DASHBOARD_SOCKETS + 2;
+  config->backlog_conn = 2;
+#if !CONFIG_LOCKBOX_HTTPS
+  // the TLS handshake needs the larger HTTPD_SSL_CONFIG_DEFAULT() stack
+  config->stack_size = 3584;
+#endif
+  config->recv_wait_timeout = 3;
+  config->send_wait_timeout = 3;
+  return "low-memory";
+#elif CONFIG_LOCKBOX_HTTPD_PROFILE_MANY_CLIENTS
+  config->max_open_sockets = CONFIG_LWIP_MAX_SOCKETS - HTTPD_INTERNAL_SOCKETS;
+  config->backlog_conn = 8;
+  config->recv_wait_timeout = 3;
+  config->send_wait_timeout = 3;
+  config->keep_alive_enable = true;
+  config->keep_alive_idle = 5;
+  config->keep_alive_interval = 5;
+  config->keep_alive_count = 3;
+  return "many-clients";
+#else
+  return "default";
+#endif
+}
+
+/* a profile that can't run as configured is refused rather than started crippled */
+static bool check_profile(const httpd_config_t *config)
+{
+  bool ok = true;
 
-  char sse_data[64];
-  while (1)
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+  if (config->max_open_sockets + HTTPD_INTERNAL_SOCKETS > CONFIG_LWIP_MAX_SOCKETS)
   {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);             // Get the current time
-    int64_t time_since_boot = tv.tv_sec; // Time since boot in seconds
-    esp_err_t err;
-    int len = snprintf(sse_data, sizeof(sse_data), "data: Time since boot: %" PRIi64 " seconds\n\n", time_since_boot);
-    if ((err = httpd_resp_send_chunk(req, sse_data, len)) != ESP_OK)
-    {
-      ESP_LOGE(TAG, "Failed to send sse data (returned %02X)", err);
-      break;
-    }
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Send data every second
+    ESP_LOGE(TAG, "%d sockets plus %d internal exceed LWIP_MAX_SOCKETS (%d)",
+             config->max_open_sockets, HTTPD_INTERNAL_SOCKETS, CONFIG_LWIP_MAX_SOCKETS);
+    ok = false;
+  }
+#endif
+  if (config->max_open_sockets < HTTPD_DASHBOARD_SOCKETS)
+  {
+    ESP_LOGE(TAG, "%d sockets can't hold a dashboard's streams and a request (%d)",
+             config->max_open_sockets, HTTPD_DASHBOARD_SOCKETS);
+    ok = false;
+  }
+#if CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
+  if (CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS >= config->max_open_sockets)
+  {
+    ESP_LOGE(TAG, "%d event stream clients would take all %d sockets",
+             CONFIG_LOCKBOX_EVENTS_MAX_CLIENTS, config->max_open_sockets);
+    ok = false;
+  }
+#endif
+  if (config->task_priority >= LOCKBOX_KEYPAD_PRIORITY)
+  {
+    ESP_LOGE(TAG, "httpd priority %u would starve the keypad (%u)",
+             (unsigned)config->task_priority, (unsigned)LOCKBOX_KEYPAD_PRIORITY);
+    ok = false;
   }
 
-  httpd_resp_send_chunk(req, NULL, 0); // End response
-  return ESP_OK;
+  return ok;
 }
 
-static const httpd_uri_t sse = {
-    .uri = "/sse",
-    .method = HTTP_GET,
-    .handler = sse_handler,
-    .user_ctx = NULL};
-#endif // CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
-
-/* --------------------------------- SERVER --------------------------------- */
-
 httpd_handle_t start_webserver(void)
 {
   httpd_handle_t server = NULL;
-  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-  config.lru_purge_enable = true;
+#if CONFIG_LOCKBOX_HTTPS
+  httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+  ssl_config.servercert = servercert_pem_start;
+  ssl_config.servercert_len = servercert_pem_end - servercert_pem_start;
+  ssl_config.prvtkey_pem = prvtkey_pem_start;
+  ssl_config.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+  ssl_config.ciphersuites_list = s_ciphersuites;
+#if CONFIG_LOCKBOX_HTTPS_SESSION_TICKETS
+  // resumed sessions skip the ECDHE + ECDSA work of a full handshake
+  ssl_config.session_tickets = true;
+#endif
+  httpd_config_t *config = &ssl_config.httpd;
+  int port = ssl_config.port_secure;
+#else
+  httpd_config_t plain_config = HTTPD_DEFAULT_CONFIG();
+  httpd_config_t *config = &plain_config;
+  int port = config->server_port;
+#endif
+  const char *profile = apply_profile(config);
+  if (!check_profile(config))
+  {
+    return NULL;
+  }
+
+  // Precompute credentials once; handlers only compare against them
+#if CONFIG_EXAMPLE_BASIC_AUTH
+  esp_err_t auth_err = http_auth_init(CONFIG_EXAMPLE_BASIC_AUTH_USERNAME, CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD);
+#else
+  esp_err_t auth_err = http_auth_init(NULL, NULL);
+#endif
+
+  index_etag_init();
+
+  // Workers for handlers too slow to run on the httpd task
+  http_async_start();
 
   // Start the httpd server
-  ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
-  if (httpd_start(&server, &config) == ESP_OK)
+  ESP_LOGI(TAG, "Starting server on port: '%d' (%s profile, %d sockets, stack %u)",
+           port, profile, config->max_open_sockets, (unsigned)config->stack_size);
+#if CONFIG_LOCKBOX_HTTPS
+  esp_err_t err = httpd_ssl_start(&server, &ssl_config);
+#else
+  esp_err_t err = httpd_start(&server, config);
+#endif
+  if (err == ESP_OK)
   {
+    // routes are re-registered from scratch on every start
+    s_route_count = 0;
+
     // Set URI handlers
-    httpd_register_uri_handler(server, &root_get_uri);
-    httpd_register_uri_handler(server, &hello);
-    httpd_register_uri_handler(server, &echo);
+    http_server_register(server, &root_get_uri);
 
     /* Register the custom error handler */
     httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, http_404_error_handler);
 
-#if CONFIG_EXAMPLE_ENABLE_SSE_HANDLER
-    httpd_register_uri_handler(server, &sse); // Register SSE handler
+    // without credentials the API stays unregistered rather than open or guessable
+    if (auth_err != ESP_OK)
+    {
+      ESP_LOGE(TAG, "API not registered until a password is set, serving / only");
+      return server;
+    }
+
+    http_server_register(server, &hello);
+    http_server_register(server, &echo);
+    http_server_register(server, &passcode_set_secret_uri);
+
+    // Register login (no-op unless CONFIG_EXAMPLE_BASIC_AUTH)
+    http_auth_register(server);
+
+    // Register event stream (no-op unless CONFIG_EXAMPLE_ENABLE_SSE_HANDLER)
+    event_stream_register(server);
+
+    // Register admin channel (no-op unless CONFIG_LOCKBOX_WS_ADMIN)
+    ws_admin_register(server);
+
+    // Register /metrics and /status
+    http_metrics_register(server);
+    status_register(server);
+
+    // Register bulk user code import
+    credentials_register(server);
+
+#if CONFIG_IDF_TARGET_LINUX
+    // Register simulated pins: scripted key presses in, recorded outputs out
+    sim_register(server);
+#else
+    // Register runtime power save switch (and its measurement probe)
+    wifi_ps_register(server);
 #endif
+
+    // Register runtime settings (cooldown, attempts, keypad timing, tones)
+    settings_register(server);
 #if CONFIG_EXAMPLE_BASIC_AUTH
-    httpd_register_basic_auth(server);
+    http_server_register(server, &basic_auth);
 #endif
     return server;
   }
@@ -380,8 +619,16 @@ httpd_handle_t start_webserver(void)
 
 static esp_err_t stop_webserver(httpd_handle_t server)
 {
+  // Drop event subscribers before their sockets are torn down
+  event_stream_unregister();
+  ws_admin_unregister();
+
   // Stop the httpd server
+#if CONFIG_LOCKBOX_HTTPS
+  return httpd_ssl_stop(server);
+#else
   return httpd_stop(server);
+#endif
 }
 
 static void disconnect_handler(void *arg, esp_event_base_t event_base,
@@ -11,6 +11,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <esp_log.h>
 #include <nvs_flash.h>
@@ -24,6 +25,7 @@
 #include "esp_netif.h"
 #include "esp_tls.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include <time.h>
 #include <sys/time.h>
 #if !CONFIG_IDF_TARGET_LINUX
@@ -35,12 +37,42 @@
 
 #define HTTP_QUERY_KEY_MAX_LEN (64)
 
+/* size of the route table; also used as httpd max_uri_handlers */
+#define HTTP_MAX_ROUTES (16)
+
+/* request latency histogram: upper bounds in µs, plus a final +Inf bucket */
+#define HTTP_LATENCY_BUCKETS (7)
+
+typedef struct
+{
+  const char *uri;
+  httpd_method_t method;
+  uint32_t requests;
+} http_route_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+extern const uint32_t http_latency_bounds_us[HTTP_LATENCY_BUCKETS - 1];
+
 httpd_handle_t start_webserver(void);
 
+/**
+ * @brief Register a URI handler through the shared dispatcher
+ *
+ * All modules register through this instead of httpd_register_uri_handler(), so
+ * every request is counted and timed before and after its handler runs.
+ * The handler still sees its own user_ctx.
+ */
+esp_err_t http_server_register(httpd_handle_t server, const httpd_uri_t *uri);
+
+/** @brief Copy per-route request counts, returns the number of routes copied */
+size_t http_server_route_stats(http_route_stats_t *stats, size_t max);
+
+/** @brief Copy the (non-cumulative) latency histogram and the total time spent in handlers */
+void http_server_latency_stats(uint32_t counts[HTTP_LATENCY_BUCKETS], uint64_t *sum_us);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,315 @@
+#include "json_writer.h"
+
+#include <string.h>
+
+/* ---------------------------------- OUTPUT -------------------------------- */
+
+static bool flush(json_writer_t *w)
+{
+  if (w->err != ESP_OK)
+  {
+    return false;
+  }
+  if (!w->flush)
+  {
+    w->err = ESP_ERR_NO_MEM;
+    return false;
+  }
+
+  w->err = w->flush(w->ctx, w->buf, w->len);
+  w->flushed = true;
+  w->len = 0;
+  return w->err == ESP_OK;
+}
+
+static void put(json_writer_t *w, const char *data, size_t len)
+{
+  while (len > 0)
+  {
+    if (w->len == w->cap && !flush(w))
+    {
+      return;
+    }
+
+    size_t n = w->cap - w->len;
+    if (n > len)
+    {
+      n = len;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+    data += n;
+    len -= n;
+  }
+}
+
+static void put_char(json_writer_t *w, char c)
+{
+  put(w, &c, 1);
+}
+
+static void put_escaped(json_writer_t *w, const char *s, size_t len)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  put_char(w, '"');
+
+  // copy runs of plain characters in one go, escape the rest
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    unsigned char c = (unsigned char)s[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+    {
+      continue;
+    }
+
+    put(w, s + start, i - start);
+    start = i + 1;
+
+    switch (c)
+    {
+    case '"':
+      put(w, "\\\"", 2);
+      break;
+    case '\\':
+      put(w, "\\\\", 2);
+      break;
+    case '\n':
+      put(w, "\\n", 2);
+      break;
+    case '\r':
+      put(w, "\\r", 2);
+      break;
+    case '\t':
+      put(w, "\\t", 2);
+      break;
+    case '\b':
+      put(w, "\\b", 2);
+      break;
+    case '\f':
+      put(w, "\\f", 2);
+      break;
+    default:
+    {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      put(w, esc, sizeof(esc));
+      break;
+    }
+    }
+  }
+  put(w, s + start, len - start);
+
+  put_char(w, '"');
+}
+
+/* --------------------------------- STRUCTURE ------------------------------- */
+
+static void separate(json_writer_t *w)
+{
+  uint32_t bit = 1u << w->depth;
+  if (w->has_items & bit)
+  {
+    put_char(w, ',');
+  }
+  w->has_items |= bit;
+}
+
+static void before_value(json_writer_t *w)
+{
+  if (w->after_key)
+  {
+    w->after_key = false;
+    return;
+  }
+  separate(w);
+}
+
+static void open_container(json_writer_t *w, char c)
+{
+  before_value(w);
+  put_char(w, c);
+
+  if (w->depth + 1 >= JSON_MAX_DEPTH)
+  {
+    w->err = ESP_ERR_INVALID_STATE;
+    return;
+  }
+  w->depth++;
+  w->has_items &= ~(1u << w->depth);
+}
+
+static void close_container(json_writer_t *w, char c)
+{
+  put_char(w, c);
+  if (w->depth > 0)
+  {
+    w->depth--;
+  }
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap, json_flush_fn flush, void *ctx)
+{
+  memset(w, 0, sizeof(*w));
+  w->buf = buf;
+  w->cap = cap;
+  w->flush = flush;
+  w->ctx = ctx;
+  w->err = ESP_OK;
+}
+
+void json_obj_begin(json_writer_t *w)
+{
+  open_container(w, '{');
+}
+
+void json_obj_end(json_writer_t *w)
+{
+  close_container(w, '}');
+}
+
+void json_arr_begin(json_writer_t *w)
+{
+  open_container(w, '[');
+}
+
+void json_arr_end(json_writer_t *w)
+{
+  close_container(w, ']');
+}
+
+/* ---------------------------------- VALUES -------------------------------- */
+
+void json_key(json_writer_t *w, const char *key)
+{
+  separate(w);
+  put_escaped(w, key, strlen(key));
+  put_char(w, ':');
+  w->after_key = true;
+}
+
+void json_str(json_writer_t *w, const char *value)
+{
+  json_strn(w, value, strlen(value));
+}
+
+void json_strn(json_writer_t *w, const char *value, size_t len)
+{
+  before_value(w);
+  put_escaped(w, value, len);
+}
+
+void json_uint(json_writer_t *w, uint64_t value)
+{
+  char digits[20];
+  char *p = digits + sizeof(digits);
+  do
+  {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  before_value(w);
+  put(w, p, digits + sizeof(digits) - p);
+}
+
+void json_int(json_writer_t *w, int64_t value)
+{
+  if (value >= 0)
+  {
+    json_uint(w, (uint64_t)value);
+    return;
+  }
+
+  char digits[21];
+  char *p = digits + sizeof(digits);
+  uint64_t u = -(uint64_t)value;
+  do
+  {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  *--p = '-';
+
+  before_value(w);
+  put(w, p, digits + sizeof(digits) - p);
+}
+
+void json_bool(json_writer_t *w, bool value)
+{
+  before_value(w);
+  if (value)
+  {
+    put(w, "true", 4);
+  }
+  else
+  {
+    put(w, "false", 5);
+  }
+}
+
+void json_null(json_writer_t *w)
+{
+  before_value(w);
+  put(w, "null", 4);
+}
+
+void json_kv_str(json_writer_t *w, const char *key, const char *value)
+{
+  json_key(w, key);
+  json_str(w, value);
+}
+
+void json_kv_int(json_writer_t *w, const char *key, int64_t value)
+{
+  json_key(w, key);
+  json_int(w, value);
+}
+
+void json_kv_uint(json_writer_t *w, const char *key, uint64_t value)
+{
+  json_key(w, key);
+  json_uint(w, value);
+}
+
+void json_kv_bool(json_writer_t *w, const char *key, bool value)
+{
+  json_key(w, key);
+  json_bool(w, value);
+}
+
+/* ---------------------------------- HTTPD --------------------------------- */
+
+static esp_err_t resp_chunk_flush(void *ctx, const char *data, size_t len)
+{
+  return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+void json_resp_init(json_writer_t *w, httpd_req_t *req, char *buf, size_t cap)
+{
+  json_writer_init(w, buf, cap, resp_chunk_flush, req);
+  httpd_resp_set_type(req, "application/json");
+}
+
+esp_err_t json_resp_end(json_writer_t *w)
+{
+  httpd_req_t *req = (httpd_req_t *)w->ctx;
+
+  if (w->err != ESP_OK)
+  {
+    // a chunked response already in flight can't be turned into an error page
+    return w->flushed ? w->err : httpd_resp_send_500(req);
+  }
+
+  // small body: one send with Content-Length, no chunked framing
+  if (!w->flushed)
+  {
+    return httpd_resp_send(req, w->buf, w->len);
+  }
+
+  if (w->len && !flush(w))
+  {
+    return w->err;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* chunk buffer size handlers usually put on their stack */
+#define JSON_CHUNK_SIZE (256)
+
+/* deepest object/array nesting supported */
+#define JSON_MAX_DEPTH (16)
+
+/** @brief Called with a full buffer; return ESP_OK to keep writing */
+typedef esp_err_t (*json_flush_fn)(void *ctx, const char *data, size_t len);
+
+/**
+ * @brief Streaming JSON serializer over a caller-owned fixed buffer
+ *
+ * Values are escaped and written straight into the buffer, which is handed to
+ * the flush function whenever it fills. There is no heap, no intermediate
+ * string and no printf. The first error is sticky; check it once at the end.
+ */
+typedef struct
+{
+  char *buf;
+  size_t cap;
+  size_t len;
+  json_flush_fn flush; // NULL: buffer is the final destination, overflow is an error
+  void *ctx;
+  esp_err_t err;
+  bool flushed;      // at least one flush happened
+  bool after_key;    // next value belongs to the key just written
+  uint8_t depth;
+  uint32_t has_items; // bit per depth: container already holds an item
+} json_writer_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap, json_flush_fn flush, void *ctx);
+
+void json_obj_begin(json_writer_t *w);
+void json_obj_end(json_writer_t *w);
+void json_arr_begin(json_writer_t *w);
+void json_arr_end(json_writer_t *w);
+
+void json_key(json_writer_t *w, const char *key);
+void json_str(json_writer_t *w, const char *value);
+void json_strn(json_writer_t *w, const char *value, size_t len);
+void json_int(json_writer_t *w, int64_t value);
+void json_uint(json_writer_t *w, uint64_t value);
+void json_bool(json_writer_t *w, bool value);
+void json_null(json_writer_t *w);
+
+/* key + value shorthands for objects */
+void json_kv_str(json_writer_t *w, const char *key, const char *value);
+void json_kv_int(json_writer_t *w, const char *key, int64_t value);
+void json_kv_uint(json_writer_t *w, const char *key, uint64_t value);
+void json_kv_bool(json_writer_t *w, const char *key, bool value);
+
+/**
+ * @brief Start a JSON response body for @p req
+ *
+ * Sets the content type. Output that fits in @p buf is sent in one piece with
+ * a Content-Length; anything larger streams out via httpd_resp_send_chunk().
+ */
+void json_resp_init(json_writer_t *w, httpd_req_t *req, char *buf, size_t cap);
+
+/** @brief Send whatever is buffered and end the response */
+esp_err_t json_resp_end(json_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
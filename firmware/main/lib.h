@@ -1,6 +0,0 @@
-#pragma once
-
-#include "nvs.h"
-#include "nvs_flash.h"
-
-void initNvs();
@@ -1,8 +1,9 @@
 /* ----------------------------------- ESP ---------------------------------- */
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <driver/gpio.h>
+#include <freertos/queue.h>
 #include <esp_timer.h>
+#include <cstdlib>
 
 /* --------------------------------- MANAGED -------------------------------- */
 #include "keypad.hpp"
@@ -10,11 +11,85 @@
 /* ---------------------------------- LOCAL --------------------------------- */
 #include "door.h"
 #include "passcode.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "hal_sim.h"
+#else
 #include "wifi_man.h"
+#endif
 #include "http_server.h"
+#include "event_stream.h"
+#include "ws_admin.h"
+#include "lockbox_api.h"
+#include "metrics.h"
+#include "status.h"
+#include "json_writer.h"
+#include "credentials.h"
+#include "settings.h"
 
 static char const *const TAG = "APP_MAIN";
 
+// longest a command from another task waits while no key is pressed
+#define APP_POLL_MS 50
+#define APP_QUEUE_LENGTH 4
+
+// count a key press and its outcome
+static void countKeyPress(PasscodeError err)
+{
+  metrics_inc(METRIC_KEYPRESSES);
+
+  switch (err)
+  {
+  case PasscodeError::VALID:
+    metrics_inc(METRIC_VALIDATE_VALID);
+    break;
+  case PasscodeError::INVALID:
+    metrics_inc(METRIC_VALIDATE_INVALID);
+    break;
+  case PasscodeError::COOLDOWN:
+    metrics_inc(METRIC_VALIDATE_COOLDOWN);
+    break;
+  case PasscodeError::REQUIRE_RESET:
+    metrics_inc(METRIC_VALIDATE_REQUIRE_RESET);
+    break;
+  default:
+    break;
+  }
+}
+
+// push a key press and its outcome to event stream subscribers
+static void publishKeyPress(char keyChar, PasscodeError err)
+{
+  char data[48];
+  json_writer_t w;
+
+  json_writer_init(&w, data, sizeof(data) - 1, NULL, NULL);
+  json_obj_begin(&w);
+  json_key(&w, "key");
+  // never leak the digits of the passcode being typed
+  if (keyChar >= '0' && keyChar <= '9')
+  {
+    json_str(&w, "digit");
+  }
+  else
+  {
+    json_strn(&w, &keyChar, 1);
+  }
+  json_obj_end(&w);
+  data[w.len] = '\0';
+  event_stream_publish("keypad", data);
+  ws_admin_key_echo(keyChar);
+
+  if (err != PasscodeError::OK && err != PasscodeError::INCOMPLETE)
+  {
+    json_writer_init(&w, data, sizeof(data) - 1, NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "result", passcodeErrorName(err));
+    json_obj_end(&w);
+    data[w.len] = '\0';
+    event_stream_publish("passcode", data);
+  }
+}
+
 // create new keypad to handle key presses
 Keypad<4, 4> keypad{
     {{{'1', '2', '3', 'A'},
@@ -27,46 +102,212 @@ Keypad<4, 4> keypad{
 // Instantiate class instance for handling passcode
 Passcode passcode{{GPIO_NUM_5, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_21}, GPIO_NUM_23, GPIO_NUM_4};
 
+/* ------------------------------ APP COMMANDS ------------------------------ */
+
+// The app task owns the passcode state and the keypad timings; other tasks
+// (httpd, async workers, the Wi-Fi event loop) post to it instead of touching
+// them directly.
+enum class AppCommand : uint8_t
+{
+  APPLY_SETTINGS,
+  CLEAR_LOCKOUT,
+  START_SERVER,
+};
+
+struct AppMessage
+{
+  AppCommand command;
+  settings_t settings; // APPLY_SETTINGS
+};
+
+static QueueHandle_t appQueue;
+
+static esp_err_t postToApp(AppMessage const &msg)
+{
+  if (xQueueSend(appQueue, &msg, pdMS_TO_TICKS(100)) != pdTRUE)
+  {
+    ESP_LOGE(TAG, "App queue full, dropped command %u", (unsigned)msg.command);
+    return ESP_ERR_TIMEOUT;
+  }
+  return ESP_OK;
+}
+
+static void applySettings(const settings_t *s)
+{
+  passcode.applySettings(*s);
+
+  // the keypad rejects a hold that isn't well above the debounce; if the new
+  // hold is below the current debounce, lower the debounce first and retry.
+  // The scan task reads these unlocked, but both stay below 2^32 us, so only
+  // the low word ever changes and it is written in one store.
+  uint64_t debounce = (uint64_t)s->debounce_ms * 1000;
+  uint64_t hold = (uint64_t)s->hold_ms * 1000;
+  if (keypad.setHoldTime(hold) != ESP_OK)
+  {
+    keypad.setDebounceTime(debounce);
+    keypad.setHoldTime(hold);
+  }
+  keypad.setDebounceTime(debounce);
+}
+
+// settings callback; runs on app_main at boot and on the httpd task after
+static esp_err_t onSettingsChanged(const settings_t *s)
+{
+  AppMessage msg{AppCommand::APPLY_SETTINGS, *s};
+  return postToApp(msg);
+}
+
+// runs on the app task only
+static void handleAppMessages()
+{
+  // httpd listens on any address, so one instance outlives disconnects and new leases
+  static httpd_handle_t server = NULL;
+
+  AppMessage msg;
+  while (xQueueReceive(appQueue, &msg, 0) == pdTRUE)
+  {
+    switch (msg.command)
+    {
+    case AppCommand::APPLY_SETTINGS:
+      applySettings(&msg.settings);
+      break;
+    case AppCommand::CLEAR_LOCKOUT:
+      passcode.clearLockout();
+      break;
+    case AppCommand::START_SERVER:
+      if (!server)
+      {
+        server = start_webserver();
+        if (server)
+        {
+          ESP_LOGI(TAG, "Web server up %" PRId64 " ms after boot", esp_timer_get_time() / 1000);
+        }
+      }
+      break;
+    }
+  }
+}
+
+/* ------------------------------- LOCKBOX API ------------------------------- */
+
+extern "C" esp_err_t lockbox_unlock(void)
+{
+  return unlockDoor();
+}
+
+extern "C" esp_err_t lockbox_relock(void)
+{
+  return lockDoor();
+}
+
+extern "C" esp_err_t lockbox_set_secret(const char *secret)
+{
+  return passcode.setSecret(secret);
+}
+
+extern "C" esp_err_t lockbox_verify_secret(const char *secret)
+{
+  return passcode.verifySecret(secret);
+}
+
+// the passcode belongs to the app task; the lockout is lifted by its next loop
+extern "C" esp_err_t lockbox_clear_lockout(void)
+{
+  AppMessage msg{AppCommand::CLEAR_LOCKOUT, {}};
+  return postToApp(msg);
+}
+
+/* -------------------------------------------------------------------------- */
+
+#if !CONFIG_IDF_TARGET_LINUX
+// runs on the event loop task, which must not block on httpd start-up; every
+// connect asks again, so a start dropped on a full queue is retried next link
+static void onWifiStateChange(WifiState state)
+{
+  if (state == WifiState::CONNECTED)
+  {
+    AppMessage msg{AppCommand::START_SERVER, {}};
+    postToApp(msg);
+  }
+}
+#endif
+
 extern "C" void app_main(void)
 {
   // debug
   esp_log_level_set("*", ESP_LOG_DEBUG);
 
-  // begin wifi in sta mode
-  WifiConf conf = {
-      .mode = WifiMode::STA,
-      .hostname = "LockBox",
-  };
-  Wifi wifi{conf};
+  // first status snapshot, before anything can change it
+  status_init();
 
-  static httpd_handle_t server = NULL;
-  /* Start the server for the first time */
-  server = start_webserver();
+  // lock pin driven shut before the API can reach it
+  esp_err_t err = initDoor();
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Door init failed (%s)", esp_err_to_name(err));
+  }
 
+  // user codes accepted besides the passcode
+  credentials_init();
 
-  // increase debounce time
-  keypad.setDebounceTime(50 * 1000);
+  // commands from other tasks, handled between key presses
+  appQueue = xQueueCreate(APP_QUEUE_LENGTH, sizeof(AppMessage));
 
-  // set hold time to 30 seconds
-  keypad.setHoldTime(30 * 1000 * 1000);
+  // tunables from flash (or defaults); changes from /settings are applied by the loop below
+  settings_init(onSettingsChanged);
+  handleAppMessages();
 
-  // begin scanning keys
+  // begin scanning keys; the keypad must not wait for the network
   keypad.beginScanTask();
 
+  // keys stay responsive under HTTP load: the scanner and this task outrank httpd
+  TaskHandle_t scanTask = xTaskGetHandle("ScanKeypad");
+  if (scanTask)
+  {
+    vTaskPrioritySet(scanTask, LOCKBOX_KEYPAD_PRIORITY);
+  }
+  vTaskPrioritySet(NULL, LOCKBOX_KEYPAD_PRIORITY);
+  ESP_LOGI(TAG, "Keypad ready %" PRId64 " ms after boot", esp_timer_get_time() / 1000);
+
+#if CONFIG_IDF_TARGET_LINUX
+  // host process: the network is already up, keys come from scripts (see hal_sim.h)
+  hal_sim_start(std::getenv("LOCKBOX_SIM_SCRIPT"));
+  AppMessage start{AppCommand::START_SERVER, {}};
+  postToApp(start);
+  handleAppMessages();
+#else
+  // begin wifi in sta mode, connecting in the background
+  WifiConf conf = {
+      .mode = WifiMode::STA,
+      .hostname = "LockBox",
+      .onStateChange = onWifiStateChange,
+  };
+  Wifi wifi{conf};
+#endif
 
+  bool firstAccepted = true;
   char keyChar{};
   while (true)
   {
-    if (keypad.getPressed(keyChar, portMAX_DELAY))
+    if (keypad.getPressed(keyChar, pdMS_TO_TICKS(APP_POLL_MS)))
     {
       ESP_LOGD(TAG, "Pressed key: %c", keyChar);
-      passcode.handleKeyPress(keyChar);
+      PasscodeError err = passcode.handleKeyPress(keyChar);
+      countKeyPress(err);
+      publishKeyPress(keyChar, err);
+
+      if (firstAccepted && err == PasscodeError::VALID)
+      {
+        firstAccepted = false;
+        ESP_LOGI(TAG, "First accepted passcode %" PRId64 " ms after boot", esp_timer_get_time() / 1000);
+      }
     }
-    else if (keypad.getHeld(keyChar, portMAX_DELAY))
+    else if (keypad.getHeld(keyChar, 0))
     {
       // TODO: Reset 
     }
-    
+
+    handleAppMessages();
     vTaskDelay(1);
   }
 }
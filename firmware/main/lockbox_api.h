@@ -0,0 +1,33 @@
+#pragma once
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * C entry points into the app objects owned by lockbox.cpp, so the HTTP side
+ * (written in C) can drive the door and passcode without knowing the classes.
+ */
+
+/* the keypad scan and app tasks run here; httpd and its workers must stay below */
+#define LOCKBOX_KEYPAD_PRIORITY (tskIDLE_PRIORITY + 6)
+
+/* ESP_ERR_INVALID_STATE if the door pins failed to initialize at boot */
+esp_err_t lockbox_unlock(void);
+esp_err_t lockbox_relock(void);
+
+/* written to flash before returning; ESP_FAIL if @p secret is malformed, else the storage error */
+esp_err_t lockbox_set_secret(const char *secret);
+
+/* ESP_OK on match, ESP_FAIL on mismatch, ESP_ERR_NVS_NOT_FOUND if no secret is set */
+esp_err_t lockbox_verify_secret(const char *secret);
+
+/* queued to the app task, which owns the passcode; ESP_ERR_TIMEOUT if its queue stays full */
+esp_err_t lockbox_clear_lockout(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,11 @@
 #include "passcode.h"
+#include "event_stream.h"
+#include "metrics.h"
+#include "status.h"
+#include "json_writer.h"
+#include "credentials.h"
+
+static_assert(CREDENTIALS_CODE_DIGITS == PASSCODE_LENGTH, "user codes must match the passcode length");
 
 static char const *const TAG = "passcode";
 
@@ -6,10 +13,35 @@ static char const *const TAG = "passcode";
 
 /* -------------------------------------------------------------------------- */
 
+char const *passcodeErrorName(PasscodeError err)
+{
+  switch (err)
+  {
+  case PasscodeError::OK:
+    return "ok";
+  case PasscodeError::FAIL:
+    return "fail";
+  case PasscodeError::INCOMPLETE:
+    return "incomplete";
+  case PasscodeError::VALID:
+    return "valid";
+  case PasscodeError::INVALID:
+    return "invalid";
+  case PasscodeError::COOLDOWN:
+    return "cooldown";
+  case PasscodeError::REQUIRE_RESET:
+    return "require_reset";
+  case PasscodeError::SECRET_INVALID_CHAR:
+    return "secret_invalid_char";
+  }
+  return "unknown";
+}
+
+/* -------------------------------------------------------------------------- */
+
 Passcode::Passcode()
 {
-  initNvs();
-  openNvsHandle();
+  loadSettings();
 }
 
 Passcode::Passcode(std::array<gpio_num_t, PASSCODE_LENGTH> inputIndicatorPins, gpio_num_t lockIndicatorPin, gpio_num_t buzzerPin)
@@ -18,22 +50,17 @@ Passcode::Passcode(std::array<gpio_num_t, PASSCODE_LENGTH> inputIndicatorPins, g
       m_buzzerPin{buzzerPin},
       m_pinsEnabled{true}
 {
-  initNvs();
-  openNvsHandle();
+  loadSettings();
   initPins();
 }
 
 Passcode::~Passcode()
 {
-  // Close NVS Handle
-  nvs_close(m_nvsHandle);
-  ESP_LOGV(TAG, "NVS handle closed.");
-
   if (m_pinsEnabled)
   {
-    ledc_stop(LOCK_SPEED_MODE, LOCK_CHANNEL, 0);
+    hal_pwm_stop(LOCK_PWM);
 
-    ledc_stop(BUZZER_SPEED_MODE, BUZZER_CHANNEL, 0);
+    hal_pwm_stop(BUZZER_PWM);
 
     if (m_blinkTaskHandle)
     {
@@ -43,73 +70,48 @@ Passcode::~Passcode()
   }
 }
 
-void Passcode::openNvsHandle()
+// runs during static init, so a storage failure is logged, not fatal: the box
+// still takes user codes and can be given a secret later
+void Passcode::loadSettings()
 {
-  // Open NVS handle
-  ESP_LOGV(TAG, "Opening Non-Volatile Storage (NVS) handle...");
-  esp_err_t err = nvs_open(TAG, NVS_READWRITE, &m_nvsHandle);
+  storage_item_t items[] = {
+      {.key = PASSCODE_SECRET_KEY, .type = NVS_TYPE_STR, .dst = m_secret, .size = sizeof(m_secret)},
+  };
+
+  esp_err_t err = storage_read(TAG, items, sizeof(items) / sizeof(items[0]));
   if (err != ESP_OK)
   {
-    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    ESP_LOGE(TAG, "Error (%s) reading settings!", esp_err_to_name(err));
+    return;
+  }
+
+  if (items[0].err != ESP_OK || strlen(m_secret) != PASSCODE_LENGTH)
+  {
+    if (items[0].err != ESP_ERR_NVS_NOT_FOUND)
+    {
+      ESP_LOGE(TAG, "Stored secret unreadable (%s)", esp_err_to_name(items[0].err));
+    }
+    m_secret[0] = '\0';
   }
 }
 
 void Passcode::initPins()
 {
-  // install fade function
-  ledc_fade_func_install(0);
-
   // register blink task
   xTaskCreate(blinkTask, "BlinkAlarm", 1024, this, 0, &m_blinkTaskHandle);
 
   // init led pins
   for (gpio_num_t ledInputPin : m_inputIndicatorPins)
   {
-    gpio_set_direction(ledInputPin, GPIO_MODE_OUTPUT);
-    gpio_set_level(ledInputPin, 0);
+    hal_gpio_output(ledInputPin);
+    hal_gpio_set(ledInputPin, 0);
   }
 
   // init lock pin
-  ledc_timer_config_t lockTimerConfig = {
-      .speed_mode = LOCK_SPEED_MODE,
-      .duty_resolution = LOCK_DUTY_RESOLUTION,
-      .timer_num = LOCK_TIMER,
-      .freq_hz = LOCK_FREQUENCY, // 2kHz
-      .clk_cfg = LOCK_CLK_CFG,
-  };
-  ledc_timer_config(&lockTimerConfig);
-
-  ledc_channel_config_t lockChannelConfig = {
-      .gpio_num = m_lockIndicatorPin,
-      .speed_mode = LOCK_SPEED_MODE,
-      .channel = LOCK_CHANNEL,
-      .intr_type = LOCK_INTR_TYPE,
-      .timer_sel = LOCK_TIMER,
-      .duty = 0,
-      .hpoint = 0,
-  };
-  ledc_channel_config(&lockChannelConfig);
+  hal_pwm_init(LOCK_PWM, m_lockIndicatorPin, LOCK_FREQUENCY, LOCK_DUTY_RESOLUTION);
 
   // init buzzer pin
-  ledc_timer_config_t buzzerTimerConfig = {
-      .speed_mode = BUZZER_SPEED_MODE,
-      .duty_resolution = BUZZER_DUTY_RESOLUTION,
-      .timer_num = BUZZER_TIMER,
-      .freq_hz = BUZZER_FREQUENCY, // 2kHz
-      .clk_cfg = BUZZER_CLK_CFG,
-  };
-  ledc_timer_config(&buzzerTimerConfig);
-
-  ledc_channel_config_t buzzerChannelConfig = {
-      .gpio_num = m_buzzerPin,
-      .speed_mode = BUZZER_SPEED_MODE,
-      .channel = BUZZER_CHANNEL,
-      .intr_type = BUZZER_INTR_TYPE,
-      .timer_sel = BUZZER_TIMER,
-      .duty = 0,
-      .hpoint = 0,
-  };
-  ledc_channel_config(&buzzerChannelConfig);
+  hal_pwm_init(BUZZER_PWM, m_buzzerPin, m_toneAlarm, BUZZER_DUTY_RESOLUTION);
 }
 
 void Passcode::append(char inputChar)
@@ -132,7 +134,7 @@ void Passcode::append(char inputChar)
   {
     // turn on led at this position
     gpio_num_t ledPin = m_inputIndicatorPins[m_inputPos];
-    gpio_set_level(ledPin, 1);
+    hal_gpio_set(ledPin, 1);
 
     inputBeep();
   }
@@ -159,7 +161,7 @@ void Passcode::pop()
     {
       // turn off the led at this position
       gpio_num_t ledPin = m_inputIndicatorPins[m_inputPos];
-      gpio_set_level(ledPin, 0);
+      hal_gpio_set(ledPin, 0);
 
       inputBeep();
     }
@@ -185,7 +187,7 @@ void Passcode::clear()
       {
         // turn off the led at this position
         gpio_num_t ledPin = m_inputIndicatorPins[m_inputPos];
-        gpio_set_level(ledPin, 0);
+        hal_gpio_set(ledPin, 0);
       }
     }
   }
@@ -200,30 +202,31 @@ PasscodeError Passcode::validate()
     return PasscodeError::INCOMPLETE;
   }
 
-  size_t secretLength = PASSCODE_LENGTH + 1; // account for the null character
-  char secret[secretLength];
+  char secret[PASSCODE_LENGTH + 1];
+  taskENTER_CRITICAL(&m_secretLock);
+  memcpy(secret, m_secret, sizeof(secret));
+  taskEXIT_CRITICAL(&m_secretLock);
 
-  // get secret passcode while ensuring no errors
-  ESP_ERROR_CHECK(nvs_get_str(m_nvsHandle, PASSCODE_SECRET_KEY, secret, &secretLength));
+  // a box provisioned with user codes only may have no secret
+  bool hasSecret = secret[0] != '\0';
 
   // log the secret passcode for verification
-  ESP_LOGD(TAG, "secret = %s", secret);
+  ESP_LOGD(TAG, "secret = %s", hasSecret ? secret : "(unset)");
 
-  // validate input
-  for (int i = 0; i < PASSCODE_LENGTH; i++)
+  // validate input against the secret, then the imported user codes
+  bool valid = hasSecret;
+  for (int i = 0; valid && i < PASSCODE_LENGTH; i++)
   {
-    if (m_input[i] != secret[i])
-    {
-      // clear input
-      clear();
-
-      return PasscodeError::INVALID;
-    }
+    valid = m_input[i] == secret[i];
+  }
+  if (!valid)
+  {
+    valid = credentials_contains(m_input);
   }
 
   // clear input
   clear();
-  return PasscodeError::VALID;
+  return valid ? PasscodeError::VALID : PasscodeError::INVALID;
 }
 
 PasscodeError Passcode::handleKeyPress(char inputChar)
@@ -238,8 +241,8 @@ PasscodeError Passcode::handleKeyPress(char inputChar)
   // cooldown started but isn't over yet
   else if (m_cooldownTimer > 0 && esp_timer_get_time() - m_cooldownTimer < m_cooldown)
   {
-    uint8_t secondsLeft = (m_cooldown + m_cooldownTimer - esp_timer_get_time()) / (1 * 1000 * 1000);
-    ESP_LOGI(TAG, "Try again after %u seconds.", secondsLeft);
+    uint32_t secondsLeft = (m_cooldown + m_cooldownTimer - esp_timer_get_time()) / (1 * 1000 * 1000);
+    ESP_LOGI(TAG, "Try again after %" PRIu32 " seconds.", secondsLeft);
     clear();
     return PasscodeError::COOLDOWN;
   }
@@ -265,6 +268,9 @@ PasscodeError Passcode::handleKeyPress(char inputChar)
       {
         m_isLocked = true;
         ESP_LOGI(TAG, "All tries have been exhausted. The passcode is now locked from further input.");
+        metrics_inc(METRIC_LOCKOUTS);
+        status_set_lockout(STATUS_LOCKOUT_LOCKED, 0);
+        event_stream_publish("lockout", "{\"state\":\"locked\"}");
         return err;
       }
       else if (err == PasscodeError::VALID)
@@ -314,6 +320,12 @@ void Passcode::onValid()
 {
   ESP_LOGI(TAG, "Passcode valid.");
 
+  if (m_cooldownTimer > 0)
+  {
+    status_set_lockout(STATUS_LOCKOUT_NONE, 0);
+    event_stream_publish("lockout", "{\"state\":\"clear\"}");
+  }
+
   // reset the countdown
   m_cooldownTimer = 0;
 
@@ -329,16 +341,27 @@ void Passcode::onValid()
 void Passcode::onInvalid()
 {
   // increment failed attempts count and check for max incorrect
-  if (++m_incorrectAttempts == PASSCODE_MAX_INCORRECT_ATTEMPTS)
+  // >= so a limit lowered at runtime below the current count still trips
+  if (++m_incorrectAttempts >= m_maxAttempts)
   {
     // start cooldown timer
     m_cooldownTimer = esp_timer_get_time();
+    metrics_inc(METRIC_LOCKOUTS);
+    status_set_lockout(STATUS_LOCKOUT_COOLDOWN, (m_cooldownTimer + m_cooldown) / (1000 * 1000));
 
     // fade locked led
-    ledc_set_duty(LOCK_SPEED_MODE, LOCK_CHANNEL, 1000);
-    ledc_update_duty(LOCK_SPEED_MODE, LOCK_CHANNEL);
-
-    ledc_set_fade_time_and_start(LOCK_SPEED_MODE, LOCK_CHANNEL, 0, m_cooldown / 1000, LEDC_FADE_NO_WAIT);
+    hal_pwm_set_duty(LOCK_PWM, 1000);
+    hal_pwm_fade(LOCK_PWM, 0, m_cooldown / 1000);
+
+    char data[48];
+    json_writer_t w;
+    json_writer_init(&w, data, sizeof(data) - 1, NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "state", "cooldown");
+    json_kv_uint(&w, "seconds", m_cooldown / (1000 * 1000));
+    json_obj_end(&w);
+    data[w.len] = '\0';
+    event_stream_publish("lockout", data);
   };
 
   if (m_pinsEnabled)
@@ -346,7 +369,7 @@ void Passcode::onInvalid()
     invalidBeep();
   }
 
-  ESP_LOGI(TAG, "Passcode wrong. You have %d tries left.", PASSCODE_MAX_INCORRECT_ATTEMPTS - m_incorrectAttempts);
+  ESP_LOGI(TAG, "Passcode wrong. You have %d tries left.", m_incorrectAttempts < m_maxAttempts ? m_maxAttempts - m_incorrectAttempts : 0);
 }
 
 esp_err_t Passcode::setSecret(char const *newSecret)
@@ -372,30 +395,90 @@ esp_err_t Passcode::setSecret(char const *newSecret)
     }
   }
 
-  // store passcode
+  // commit now rather than behind: a failed flush drops the write, and the
+  // caller must hear about it before the old secret is forgotten
   ESP_LOGV(TAG, "Writing string to NVS...");
-
-  // write new secret passcode to nvs
-  err = nvs_set_str(m_nvsHandle, PASSCODE_SECRET_KEY, newSecret);
+  err = storage_set_str(TAG, PASSCODE_SECRET_KEY, newSecret);
+  if (err == ESP_OK)
+  {
+    err = storage_flush();
+  }
   if (err != ESP_OK)
   {
-    ESP_LOGE(TAG, "Failed to write passcode's!");
+    ESP_LOGE(TAG, "Failed to write passcode's! (%s)", esp_err_to_name(err));
+    return err;
+  }
+
+  taskENTER_CRITICAL(&m_secretLock);
+  memcpy(m_secret, newSecret, PASSCODE_LENGTH + 1);
+  taskEXIT_CRITICAL(&m_secretLock);
+
+  return ESP_OK;
+}
+
+esp_err_t Passcode::verifySecret(char const *candidate)
+{
+  char secret[PASSCODE_LENGTH + 1];
+  taskENTER_CRITICAL(&m_secretLock);
+  memcpy(secret, m_secret, sizeof(secret));
+  taskEXIT_CRITICAL(&m_secretLock);
+
+  if (secret[0] == '\0')
+  {
+    // no secret has been set yet
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  if (strlen(candidate) != PASSCODE_LENGTH)
+  {
     return ESP_FAIL;
   }
 
-  // Commit changes
-  // After setting any values, nvs_commit() must be called to ensure changes are written
-  // to flash storage. Implementations may write to storage at other times,
-  // but this is not guaranteed.
-  ESP_LOGV(TAG, "Committing updates in NVS...");
-  err = nvs_commit(m_nvsHandle);
-  if (err != ESP_OK)
+  // compare every digit so timing doesn't reveal how much matched
+  uint8_t diff = 0;
+  for (int i = 0; i < PASSCODE_LENGTH; i++)
   {
-    ESP_LOGE(TAG, "Failed to commit NVS changes!");
+    diff |= secret[i] ^ candidate[i];
   }
-  ESP_LOGV(TAG, "NVS handle closed.");
+  memset(secret, 0, sizeof(secret));
 
-  return ESP_OK;
+  return diff ? ESP_FAIL : ESP_OK;
+}
+
+void Passcode::applySettings(settings_t const &settings)
+{
+  m_cooldown = (uint64_t)settings.cooldown_ms * 1000;
+  m_maxAttempts = settings.max_attempts;
+  m_toneInput = settings.tone_input_hz;
+  m_toneValid = settings.tone_valid_hz;
+  m_toneInvalid = settings.tone_invalid_hz;
+  m_toneAlarm = settings.tone_alarm_hz;
+
+  ESP_LOGI(TAG, "Cooldown %" PRIu32 " ms after %u wrong tries", settings.cooldown_ms, m_maxAttempts);
+}
+
+void Passcode::clearLockout()
+{
+  bool wasLocked = m_isLocked || m_cooldownTimer > 0;
+
+  m_isLocked = false;
+  m_cooldownTimer = 0;
+  m_incorrectAttempts = 0;
+  clear();
+
+  if (m_pinsEnabled)
+  {
+    // silence the alarm and turn off the lock indicator
+    hal_pwm_set_duty(BUZZER_PWM, 0);
+    hal_pwm_set_duty(LOCK_PWM, 0);
+  }
+
+  if (wasLocked)
+  {
+    ESP_LOGI(TAG, "Lockout cleared.");
+    status_set_lockout(STATUS_LOCKOUT_NONE, 0);
+    event_stream_publish("lockout", "{\"state\":\"clear\"}");
+  }
 }
 
 esp_err_t Passcode::resetSecret() {
@@ -405,7 +488,7 @@ esp_err_t Passcode::resetSecret() {
 
 void Passcode::print()
 {
-  ESP_LOGD(TAG, "Input(%d): %s", m_inputPos, m_input);
+  ESP_LOGD(TAG, "Input(%u): %.*s", (unsigned)m_inputPos, (int)m_inputPos, m_input);
 }
 
 void _beep(uint32_t freq, uint32_t duration)
@@ -413,35 +496,33 @@ void _beep(uint32_t freq, uint32_t duration)
   uint32_t duty = (1 << (BUZZER_DUTY_RESOLUTION - 1)); // set to the maximum duty cycle
 
   // start the buzzer
-  ledc_set_freq(BUZZER_SPEED_MODE, BUZZER_TIMER, freq);
-  ledc_set_duty(BUZZER_SPEED_MODE, BUZZER_CHANNEL, duty);
-  ledc_update_duty(BUZZER_SPEED_MODE, BUZZER_CHANNEL);
+  hal_pwm_set_freq(BUZZER_PWM, freq);
+  hal_pwm_set_duty(BUZZER_PWM, duty);
 
   vTaskDelay(duration / portTICK_PERIOD_MS);
 
   // bring it back low
-  ledc_set_duty(BUZZER_SPEED_MODE, BUZZER_CHANNEL, 0);
-  ledc_update_duty(BUZZER_SPEED_MODE, BUZZER_CHANNEL);
+  hal_pwm_set_duty(BUZZER_PWM, 0);
 }
 
 void Passcode::inputBeep()
 {
-  // 800Hz for 100ms
-  _beep(800, 100);
+  // 100ms
+  _beep(m_toneInput, 100);
 }
 
 void Passcode::validBeep()
 {
-  // 2kHz for 500ms
-  _beep(2000, 500);
+  // 500ms
+  _beep(m_toneValid, 500);
 }
 
 void Passcode::invalidBeep()
 {
-  // 400Hz for 100ms
-  _beep(440, 200);
+  // 200ms
+  _beep(m_toneInvalid, 200);
 
-  // 350Hz for 100ms
+  // falling 200Hz tail for 300ms
   _beep(200, 300);
 }
 
@@ -455,16 +536,14 @@ void Passcode::blink()
     if (m_isLocked)
     {
       // ring an alarm
-      ledc_set_freq(BUZZER_SPEED_MODE, BUZZER_TIMER, BUZZER_FREQUENCY);
-      ledc_set_duty_and_update(BUZZER_SPEED_MODE, BUZZER_CHANNEL, buzzerDuty, 0);
+      hal_pwm_set_freq(BUZZER_PWM, m_toneAlarm);
+      hal_pwm_set_duty(BUZZER_PWM, buzzerDuty);
 
-      ledc_set_duty(LOCK_SPEED_MODE, LOCK_CHANNEL, lockDuty);
-      ledc_update_duty(LOCK_SPEED_MODE, LOCK_CHANNEL);
+      hal_pwm_set_duty(LOCK_PWM, lockDuty);
 
       vTaskDelay(500 / portTICK_PERIOD_MS);
 
-      ledc_set_duty(LOCK_SPEED_MODE, LOCK_CHANNEL, 0);
-      ledc_update_duty(LOCK_SPEED_MODE, LOCK_CHANNEL);
+      hal_pwm_set_duty(LOCK_PWM, 0);
 
       vTaskDelay(500 / portTICK_PERIOD_MS);
     }
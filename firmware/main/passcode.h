@@ -2,39 +2,25 @@
 
 /* -------------------------------- INCLUDES -------------------------------- */
 #include <freertos/FreeRTOS.h>
-#include <driver/gpio.h>
-#include <driver/ledc.h>
 #include <esp_timer.h>
 #include <esp_log.h>
-#include <nvs.h>
-#include <nvs_flash.h>
 #include <array>
 #include <cmath>
+#include <cinttypes>
 //
-extern "C"
-{
-#include "lib.h"
-}
+#include "hal.h"
+#include "storage.h"
+#include "settings.h"
 
 /* --------------------------------- DEFINES -------------------------------- */
 #define PASSCODE_LENGTH 4
 #define PASSCODE_SECRET_KEY "secretPasscode"
-#define PASSCODE_MAX_INCORRECT_ATTEMPTS 3
 //
-#define BUZZER_SPEED_MODE LEDC_HIGH_SPEED_MODE
-#define BUZZER_DUTY_RESOLUTION LEDC_TIMER_10_BIT
-#define BUZZER_TIMER LEDC_TIMER_0
-#define BUZZER_CLK_CFG LEDC_AUTO_CLK
-#define BUZZER_INTR_TYPE LEDC_INTR_DISABLE
-#define BUZZER_CHANNEL LEDC_CHANNEL_0
-#define BUZZER_FREQUENCY 4000 // > 2kHz
+#define BUZZER_PWM 0
+#define BUZZER_DUTY_RESOLUTION 10 // bits
 //
-#define LOCK_SPEED_MODE LEDC_LOW_SPEED_MODE
-#define LOCK_DUTY_RESOLUTION LEDC_TIMER_10_BIT
-#define LOCK_TIMER LEDC_TIMER_1
-#define LOCK_CLK_CFG LEDC_AUTO_CLK
-#define LOCK_INTR_TYPE LEDC_INTR_DISABLE
-#define LOCK_CHANNEL LEDC_CHANNEL_1
+#define LOCK_PWM 1
+#define LOCK_DUTY_RESOLUTION 10 // bits
 #define LOCK_FREQUENCY 1000 // 1kHz
 
 /* -------------------------------------------------------------------------- */
@@ -51,6 +37,9 @@ enum class PasscodeError
   SECRET_INVALID_CHAR,
 };
 
+/* short lowercase name of a PasscodeError, used in logs and pushed events */
+char const *passcodeErrorName(PasscodeError err);
+
 /* -------------------------------------------------------------------------- */
 class Passcode
 {
@@ -63,13 +52,25 @@ public:
   void handleKeyHold(char inputChar);
 
   esp_err_t setSecret(char const *newSecret);
+  esp_err_t verifySecret(char const *candidate);
   esp_err_t resetSecret();
 
+  // lift a cooldown or a full lock, e.g. on admin request; like handleKeyPress(),
+  // only call it from the task that handles the keys
+  void clearLockout();
+
+  // cooldown, attempt limit and tones; takes effect from the next key press.
+  // Same task as handleKeyPress()
+  void applySettings(settings_t const &settings);
+
   void print();
 
 private:
   TaskHandle_t m_blinkTaskHandle{nullptr};
-  nvs_handle_t m_nvsHandle;
+
+  // loaded once at boot and kept in step by setSecret(); empty if none is set
+  char m_secret[PASSCODE_LENGTH + 1]{'\0'};
+  portMUX_TYPE m_secretLock = portMUX_INITIALIZER_UNLOCKED;
 
   std::array<gpio_num_t, PASSCODE_LENGTH> m_inputIndicatorPins;
   gpio_num_t m_lockIndicatorPin;
@@ -85,6 +86,13 @@ private:
 
   // keeps track of the number of incorrect attempts so far
   uint8_t m_incorrectAttempts{0};
+  uint8_t m_maxAttempts{3};
+
+  /* buzzer tones in Hz; the alarm should stay above 2kHz to be heard */
+  uint32_t m_toneInput{800};
+  uint32_t m_toneValid{2000};
+  uint32_t m_toneInvalid{440};
+  uint32_t m_toneAlarm{4000};
 
   // defines whether the passcode can accept validations
   bool m_isLocked{false};
@@ -97,7 +105,7 @@ private:
 
 private:
   /* --------------------------- constructor helpers -------------------------- */
-  void openNvsHandle();
+  void loadSettings();
   void initPins();
 
 private:
@@ -365,14 +365,189 @@ done:
 }
 
 
+/*
+ * Fast paths used by example_uri_encode() / example_uri_decode(). Output is
+ * byte-for-byte the same as ngx_escape_uri(NGX_ESCAPE_URI_COMPONENT) and
+ * ngx_unescape_uri(NGX_UNESCAPE_URI) above, but clean spans are found a word
+ * at a time (or through a byte table) and copied with memcpy/memmove.
+ */
+
+/* 1 if the byte must be %-escaped in a URI component: not ALPHA, DIGIT, "-", ".", "_", "~" */
+static const u_char uri_component_escape[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 00-0F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 10-1F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1,  /* 20-2F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1,  /* 30-3F */
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 40-4F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0,  /* 50-5F */
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 60-6F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 1,  /* 70-7F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 80-8F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 90-9F */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* A0-AF */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* B0-BF */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* C0-CF */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* D0-DF */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* E0-EF */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* F0-FF */
+};
+
+/* 0 if not a hex digit, else its value + 1 */
+static const u_char hex_value[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 00-0F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 10-1F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 20-2F */
+     1,  2,  3,  4,  5,  6,  7,  8,  9, 10,  0,  0,  0,  0,  0,  0,  /* 30-3F */
+     0, 11, 12, 13, 14, 15, 16,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 40-4F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 50-5F */
+     0, 11, 12, 13, 14, 15, 16,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 60-6F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 70-7F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 80-8F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* 90-9F */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* A0-AF */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* B0-BF */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* C0-CF */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* D0-DF */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* E0-EF */
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  /* F0-FF */
+};
+
+#define WORD_ONES   ((uintptr_t) -1 / 0xff)
+#define WORD_HIGHS  (WORD_ONES * 0x80)
+
+/* non-zero if any byte of w equals c */
+static inline uintptr_t word_has_byte(uintptr_t w, u_char c)
+{
+    uintptr_t x = w ^ (WORD_ONES * c);
+    return (x - WORD_ONES) & ~x & WORD_HIGHS;
+}
+
+/* length of the leading run without '%' or @p special, the only bytes decoding acts on */
+static size_t uri_clean_span(const u_char *s, size_t size, u_char special)
+{
+    size_t i = 0;
+
+    for ( /* void */ ; i + sizeof(uintptr_t) <= size; i += sizeof(uintptr_t)) {
+        uintptr_t w;
+        memcpy(&w, s + i, sizeof(w));
+
+        if (word_has_byte(w, '%') | word_has_byte(w, special)) {
+            break;
+        }
+    }
+
+    while (i < size && s[i] != '%' && s[i] != special) {
+        i++;
+    }
+
+    return i;
+}
+
+
 uint32_t example_uri_encode(char *dest, const char *src, size_t len)
 {
+    static const u_char hex[] = "0123456789ABCDEF";
+
     if (!src || !dest) {
         return 0;
     }
 
-    uintptr_t ret = ngx_escape_uri((unsigned char *)dest, (unsigned char *)src, len, NGX_ESCAPE_URI_COMPONENT);
-    return (uint32_t)(ret - (uintptr_t)dest);
+    const u_char *s = (const u_char *)src;
+    const u_char *end = s + len;
+    u_char *d = (u_char *)dest;
+
+    while (s < end) {
+        const u_char *run = s;
+        while (s < end && !uri_component_escape[*s]) {
+            s++;
+        }
+
+        memcpy(d, run, s - run);
+        d += s - run;
+
+        if (s == end) {
+            break;
+        }
+
+        *d++ = '%';
+        *d++ = hex[*s >> 4];
+        *d++ = hex[*s & 0xf];
+        s++;
+    }
+
+    return (uint32_t)(d - (u_char *)dest);
+}
+
+
+/*
+ * ngx_unescape_uri() with type NGX_UNESCAPE_URI, or with type 0 plus '+' to
+ * space for an argument. dest may be NULL to only count the output.
+ */
+static size_t uri_decode(u_char *dest, const u_char *src, size_t len, int arg)
+{
+    const u_char special = arg ? '+' : '?';
+    const u_char *s = src;
+    const u_char *end = s + len;
+    size_t n = 0;
+
+#define PUT(ch) do { if (dest) { dest[n] = (ch); } n++; } while (0)
+
+    while (s < end) {
+        size_t clean = uri_clean_span(s, end - s, special);
+
+        /* output never gets ahead of input, so dest == src is fine */
+        if (dest && dest + n != s) {
+            memmove(dest + n, s, clean);
+        }
+        n += clean;
+        s += clean;
+
+        if (s == end) {
+            break;
+        }
+
+        u_char c = *s++;
+        if (c == '?') {
+            PUT('?');
+            break;
+        }
+        if (c == '+') {
+            PUT(' ');
+            continue;
+        }
+
+        /* '%': a bad first digit is kept (the '%' is not, and an argument's '+' is
+         * still a space), a bad second drops all three */
+        if (s == end) {
+            break;
+        }
+        u_char hi = hex_value[*s];
+        if (!hi) {
+            PUT(arg && *s == '+' ? ' ' : *s);
+            s++;
+            continue;
+        }
+
+        if (++s == end) {
+            break;
+        }
+        u_char lo = hex_value[*s++];
+        if (!lo) {
+            continue;
+        }
+
+        u_char ch = (u_char) (((hi - 1) << 4) + (lo - 1));
+        PUT(ch);
+
+        /* like ngx_unescape_uri(), an escaped "?" ends the URI part too */
+        if (ch == '?' && !arg) {
+            break;
+        }
+    }
+
+#undef PUT
+
+    return n;
 }
 
 
@@ -382,7 +557,15 @@ void example_uri_decode(char *dest, const char *src, size_t len)
         return;
     }
 
-    unsigned char *src_ptr = (unsigned char *)src;
-    unsigned char *dst_ptr = (unsigned char *)dest;
-    ngx_unescape_uri(&dst_ptr, &src_ptr, len, NGX_UNESCAPE_URI);
+    uri_decode((u_char *)dest, (const u_char *)src, len, 0);
+}
+
+
+size_t example_uri_decode_arg(char *dest, const char *src, size_t len)
+{
+    if (!src) {
+        return 0;
+    }
+
+    return uri_decode((u_char *)dest, (const u_char *)src, len, 1);
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,9 +42,26 @@ uint32_t example_uri_encode(char *dest, const char *src, size_t len);
  *       special character will take up 2 less bytes than its encoded form.
  *       In the worst-case scenario, the destination buffer will have to be
  *       the same size that of the source string.
+ *
+ * @note dest may equal src to decode in place.
  */
 void example_uri_decode(char *dest, const char *src, size_t len);
 
+/**
+ * @brief Decode a query or form value
+ *
+ * Same escape rules as example_uri_decode(), except that '?' is ordinary data
+ * and '+' decodes to a space, as in application/x-www-form-urlencoded.
+ *
+ * @param dest  a destination memory location, or NULL to only measure
+ * @param src   the source string
+ * @param len   the length of the source string
+ * @return size_t  bytes written to dest (or that would be); no NUL is added
+ *
+ * @note dest may equal src to decode in place.
+ */
+size_t example_uri_decode_arg(char *dest, const char *src, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
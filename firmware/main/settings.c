@@ -0,0 +1,346 @@
+#include "settings.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+
+#include "storage.h"
+#include "credentials.h"
+#include "http_auth.h"
+#include "http_server.h"
+#include "http_query.h"
+#include "json_writer.h"
+
+static const char *TAG = "settings";
+
+#define SETTINGS_NAMESPACE "settings"
+#define SETTINGS_KEY "device"
+
+/* form bodies are a handful of short key=value pairs */
+#define SETTINGS_BODY_MAX (256)
+
+static const settings_t s_defaults = {
+    .version = SETTINGS_VERSION,
+    .size = sizeof(settings_t),
+    .cooldown_ms = 30 * 1000,
+    .max_attempts = 3,
+    .debounce_ms = 50,
+    .hold_ms = 30 * 1000,
+    .tone_input_hz = 800,
+    .tone_valid_hz = 2000,
+    .tone_invalid_hz = 440,
+    .tone_alarm_hz = 4000,
+};
+
+static settings_t s_settings;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static settings_apply_cb_t s_apply;
+
+/* ------------------------------ FIELD TABLE ------------------------------- */
+
+typedef struct
+{
+  const char *name;
+  size_t offset;
+  uint8_t width; // bytes: 1, 2 or 4
+  uint32_t min;
+  uint32_t max;
+} settings_field_t;
+
+#define FIELD(name, min, max) {#name, offsetof(settings_t, name), sizeof(((settings_t *)0)->name), min, max}
+
+static const settings_field_t s_fields[] = {
+    FIELD(cooldown_ms, 1000, 3600 * 1000),
+    FIELD(max_attempts, 1, 20),
+    FIELD(debounce_ms, 2, 500),
+    FIELD(hold_ms, 500, 120 * 1000),
+    FIELD(tone_input_hz, 100, 10000),
+    FIELD(tone_valid_hz, 100, 10000),
+    FIELD(tone_invalid_hz, 100, 10000),
+    FIELD(tone_alarm_hz, 100, 10000),
+};
+
+#define FIELD_COUNT (sizeof(s_fields) / sizeof(s_fields[0]))
+
+static uint32_t field_get(const settings_t *s, const settings_field_t *f)
+{
+  const uint8_t *p = (const uint8_t *)s + f->offset;
+  switch (f->width)
+  {
+  case 1:
+    return *p;
+  case 2:
+    return *(const uint16_t *)p;
+  default:
+    return *(const uint32_t *)p;
+  }
+}
+
+static void field_set(settings_t *s, const settings_field_t *f, uint32_t value)
+{
+  uint8_t *p = (uint8_t *)s + f->offset;
+  switch (f->width)
+  {
+  case 1:
+    *p = (uint8_t)value;
+    break;
+  case 2:
+    *(uint16_t *)p = (uint16_t)value;
+    break;
+  default:
+    *(uint32_t *)p = value;
+    break;
+  }
+}
+
+static const char *validate(const settings_t *s)
+{
+  for (size_t i = 0; i < FIELD_COUNT; i++)
+  {
+    uint32_t value = field_get(s, &s_fields[i]);
+    if (value < s_fields[i].min || value > s_fields[i].max)
+    {
+      return s_fields[i].name;
+    }
+  }
+
+  // the keypad needs a clear gap between a press and a hold
+  if (s->hold_ms <= s->debounce_ms + 100)
+  {
+    return "hold_ms";
+  }
+  return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t settings_init(settings_apply_cb_t apply)
+{
+  s_apply = apply;
+
+  settings_t stored;
+  storage_item_t items[] = {
+      {.key = SETTINGS_KEY, .type = NVS_TYPE_BLOB, .dst = &stored, .size = sizeof(stored)},
+  };
+  esp_err_t err = storage_read(SETTINGS_NAMESPACE, items, 1);
+
+  settings_t loaded = s_defaults;
+  if (err == ESP_OK && items[0].err == ESP_OK && items[0].size >= offsetof(settings_t, cooldown_ms))
+  {
+    // fields added since the blob was written keep their defaults
+    size_t len = stored.size < items[0].size ? stored.size : items[0].size;
+    memcpy(&loaded, &stored, len < sizeof(loaded) ? len : sizeof(loaded));
+    loaded.version = SETTINGS_VERSION;
+    loaded.size = sizeof(settings_t);
+
+    const char *bad = validate(&loaded);
+    if (bad)
+    {
+      ESP_LOGW(TAG, "Stored %s out of range, using defaults", bad);
+      loaded = s_defaults;
+    }
+    else
+    {
+      ESP_LOGI(TAG, "Loaded v%u settings", stored.version);
+    }
+  }
+  else if (items[0].err != ESP_ERR_NVS_NOT_FOUND)
+  {
+    ESP_LOGW(TAG, "Settings unreadable (%s), using defaults",
+             esp_err_to_name(err != ESP_OK ? err : items[0].err));
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_settings = loaded;
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (s_apply && s_apply(&loaded) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to apply loaded settings");
+  }
+  return ESP_OK;
+}
+
+void settings_get(settings_t *settings)
+{
+  taskENTER_CRITICAL(&s_lock);
+  *settings = s_settings;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t settings_update(const settings_t *settings, const char **bad_field)
+{
+  settings_t next = *settings;
+  next.version = SETTINGS_VERSION;
+  next.size = sizeof(settings_t);
+
+  const char *bad = validate(&next);
+  if (bad)
+  {
+    *bad_field = bad;
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // only publish what the owners of the values will actually receive
+  if (s_apply)
+  {
+    esp_err_t err = s_apply(&next);
+    if (err != ESP_OK)
+    {
+      ESP_LOGW(TAG, "Settings not applied (%s)", esp_err_to_name(err));
+      return err;
+    }
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  s_settings = next;
+  taskEXIT_CRITICAL(&s_lock);
+
+  // written behind: a burst of edits from the dashboard costs one flash write
+  esp_err_t err = storage_set(SETTINGS_NAMESPACE, SETTINGS_KEY, NVS_TYPE_BLOB, &next, sizeof(next));
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to store settings (%s), applied until reboot", esp_err_to_name(err));
+  }
+  return ESP_OK;
+}
+
+/* -------------------------------- HANDLERS -------------------------------- */
+
+static esp_err_t send_settings(httpd_req_t *req)
+{
+  settings_t s;
+  settings_get(&s);
+
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_uint(&w, "version", s.version);
+  for (size_t i = 0; i < FIELD_COUNT; i++)
+  {
+    json_kv_uint(&w, s_fields[i].name, field_get(&s, &s_fields[i]));
+  }
+  json_kv_uint(&w, "passcode_length", CREDENTIALS_CODE_DIGITS);
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+static esp_err_t send_invalid(httpd_req_t *req, const char *field)
+{
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+
+  httpd_resp_set_status(req, "400 Bad Request");
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_str(&w, "error", "Invalid value");
+  json_kv_str(&w, "field", field);
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+static esp_err_t settings_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+  return send_settings(req);
+}
+
+static esp_err_t settings_post_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  char body[SETTINGS_BODY_MAX];
+  if (req->content_len >= sizeof(body))
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+  }
+
+  size_t received = 0;
+  while (received < req->content_len)
+  {
+    int ret = httpd_req_recv(req, body + received, req->content_len - received);
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+      continue;
+    }
+    if (ret <= 0)
+    {
+      return ESP_FAIL;
+    }
+    received += ret;
+  }
+
+  http_query_t form;
+  http_query_parse(&form, body, received);
+
+  // start from the current values so a partial update leaves the rest alone
+  settings_t next;
+  settings_get(&next);
+
+  for (size_t i = 0; i < FIELD_COUNT; i++)
+  {
+    char value[12];
+    esp_err_t err = http_query_value(&form, s_fields[i].name, value, sizeof(value));
+    if (err == ESP_ERR_NOT_FOUND)
+    {
+      continue;
+    }
+
+    // range check before field_set() narrows to the field width, or 259 would pass as 3
+    char *end;
+    unsigned long n = strtoul(value, &end, 10);
+    if (err != ESP_OK || value[0] == '\0' || *end != '\0' || n < s_fields[i].min || n > s_fields[i].max)
+    {
+      return send_invalid(req, s_fields[i].name);
+    }
+    field_set(&next, &s_fields[i], (uint32_t)n);
+  }
+
+  // cross-field checks need the full struct
+  const char *bad = NULL;
+  esp_err_t err = settings_update(&next, &bad);
+  if (err == ESP_ERR_INVALID_ARG)
+  {
+    return send_invalid(req, bad);
+  }
+  if (err != ESP_OK)
+  {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_sendstr(req, "Settings not applied, try again");
+  }
+
+  ESP_LOGI(TAG, "Settings updated");
+  return send_settings(req);
+}
+
+static const httpd_uri_t settings_get_uri = {
+    .uri = "/settings",
+    .method = HTTP_GET,
+    .handler = settings_get_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t settings_post_uri = {
+    .uri = "/settings",
+    .method = HTTP_POST,
+    .handler = settings_post_handler,
+    .user_ctx = NULL};
+
+esp_err_t settings_register(httpd_handle_t server)
+{
+  esp_err_t err = http_server_register(server, &settings_get_uri);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+  return http_server_register(server, &settings_post_uri);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* bump when settings_t changes; new fields are only ever appended */
+#define SETTINGS_VERSION (1)
+
+/*
+ * Device tunables, stored as one NVS blob. The passcode length is fixed by
+ * the LED count and the user code format, so it is reported but not stored.
+ */
+typedef struct
+{
+  uint16_t version;
+  uint16_t size; // sizeof(settings_t) when written, so older blobs can be extended
+
+  uint32_t cooldown_ms;  // lockout after max_attempts wrong tries
+  uint8_t max_attempts;  // wrong tries before the cooldown
+  uint8_t reserved[3];
+  uint32_t debounce_ms;  // keypad
+  uint32_t hold_ms;      // keypad, press length that counts as a hold
+  uint16_t tone_input_hz;
+  uint16_t tone_valid_hz;
+  uint16_t tone_invalid_hz;
+  uint16_t tone_alarm_hz;
+} settings_t;
+
+/*
+ * Called with the new settings after boot and after every accepted change.
+ * Changes arrive on the httpd task: hand them to the task that owns the values,
+ * and return an error if that failed, so the change is neither stored nor
+ * reported.
+ */
+typedef esp_err_t (*settings_apply_cb_t)(const settings_t *settings);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load the settings with one read, falling back to defaults field by field
+ *
+ * @p apply is called once before returning, on the caller's task, and again
+ * from the HTTP handler whenever a change is accepted.
+ */
+esp_err_t settings_init(settings_apply_cb_t apply);
+
+void settings_get(settings_t *settings);
+
+/**
+ * @brief Validate, apply and store (write-behind)
+ *
+ * Nothing changes unless the apply callback accepted the settings.
+ *
+ * @param bad_field set to the offending field name on ESP_ERR_INVALID_ARG
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or the apply callback's error
+ */
+esp_err_t settings_update(const settings_t *settings, const char **bad_field);
+
+/**
+ * @brief Register GET and POST /settings
+ *
+ * POST takes a form-encoded body with any subset of the fields, e.g.
+ * "cooldown_ms=60000&max_attempts=5". The whole set is validated before
+ * anything is stored, and applied without a reboot. Answers 503 if the change
+ * couldn't be handed to the app task.
+ */
+esp_err_t settings_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
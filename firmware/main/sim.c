@@ -0,0 +1,180 @@
+#include "sim.h"
+
+#include <stdlib.h>
+#include <esp_log.h>
+
+#include "hal_sim.h"
+#include "http_auth.h"
+#include "http_server.h"
+#include "http_query.h"
+#include "json_writer.h"
+
+static const char *TAG = "sim";
+
+/* scripts are typed by hand or by a test driver; this is plenty */
+#define SIM_SCRIPT_MAX (512)
+
+/* trace events copied per batch while streaming the response */
+#define SIM_TRACE_BATCH (16)
+
+static const char *kind_name(hal_sim_kind_t kind)
+{
+  switch (kind)
+  {
+  case HAL_SIM_PIN:
+    return "pin";
+  case HAL_SIM_PWM_DUTY:
+    return "duty";
+  case HAL_SIM_PWM_FREQ:
+    return "freq";
+  case HAL_SIM_PWM_FADE:
+    return "fade";
+  default:
+    return "unknown";
+  }
+}
+
+/* -------------------------------- HANDLERS -------------------------------- */
+
+static esp_err_t sim_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  uint32_t since = 0;
+  http_query_t query;
+  http_query_parse_req(&query, req);
+  char value[12];
+  if (http_query_value(&query, "since", value, sizeof(value)) == ESP_OK)
+  {
+    since = strtoul(value, NULL, 10);
+  }
+
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+
+  json_key(&w, "pwm");
+  json_arr_begin(&w);
+  for (hal_pwm_t i = 0; i < HAL_PWM_MAX; i++)
+  {
+    hal_sim_pwm_state_t pwm;
+    hal_sim_pwm_state(i, &pwm);
+    if (pwm.pin == GPIO_NUM_NC)
+    {
+      continue;
+    }
+    json_obj_begin(&w);
+    json_kv_uint(&w, "pwm", i);
+    json_kv_int(&w, "pin", pwm.pin);
+    json_kv_uint(&w, "freq_hz", pwm.freq_hz);
+    json_kv_uint(&w, "duty", pwm.duty);
+    json_obj_end(&w);
+  }
+  json_arr_end(&w);
+
+  // events recorded while this streams out are picked up by the next poll
+  uint32_t next = since;
+  json_key(&w, "events");
+  json_arr_begin(&w);
+  hal_sim_event_t events[SIM_TRACE_BATCH];
+  size_t count;
+  while ((count = hal_sim_trace(next, events, SIM_TRACE_BATCH)) > 0)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      json_obj_begin(&w);
+      json_kv_uint(&w, "seq", events[i].seq);
+      json_kv_int(&w, "time_us", events[i].time_us);
+      json_kv_str(&w, "kind", kind_name(events[i].kind));
+      json_kv_uint(&w, "index", events[i].index);
+      json_kv_uint(&w, "value", events[i].value);
+      json_obj_end(&w);
+    }
+    next = events[count - 1].seq + 1;
+  }
+  json_arr_end(&w);
+  json_kv_uint(&w, "next", next);
+
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+static esp_err_t sim_post_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  char body[SIM_SCRIPT_MAX];
+  if (req->content_len >= sizeof(body))
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+  }
+
+  size_t received = 0;
+  while (received < req->content_len)
+  {
+    int ret = httpd_req_recv(req, body + received, req->content_len - received);
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+      continue;
+    }
+    if (ret <= 0)
+    {
+      return ESP_FAIL;
+    }
+    received += ret;
+  }
+
+  http_query_t form;
+  http_query_parse(&form, body, received);
+
+  char script[SIM_SCRIPT_MAX];
+  if (http_query_value(&form, "script", script, sizeof(script)) != ESP_OK)
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing script");
+  }
+
+  esp_err_t err = hal_sim_run(script);
+  if (err == ESP_ERR_INVALID_ARG)
+  {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed script or unknown key");
+  }
+  if (err != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Script not queued (%s)", esp_err_to_name(err));
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_sendstr(req, "Script queue full");
+  }
+
+  // played in the background; poll GET /sim for what it did
+  httpd_resp_set_status(req, "202 Accepted");
+  return httpd_resp_send(req, NULL, 0);
+}
+
+static const httpd_uri_t sim_get_uri = {
+    .uri = "/sim",
+    .method = HTTP_GET,
+    .handler = sim_get_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t sim_post_uri = {
+    .uri = "/sim",
+    .method = HTTP_POST,
+    .handler = sim_post_handler,
+    .user_ctx = NULL};
+
+esp_err_t sim_register(httpd_handle_t server)
+{
+  esp_err_t err = http_server_register(server, &sim_get_uri);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+  return http_server_register(server, &sim_post_uri);
+}
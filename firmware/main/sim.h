@@ -0,0 +1,22 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register GET and POST /sim (linux target only)
+ *
+ * GET returns the PWM outputs and the recorded pin/PWM changes since
+ * "?since=N"; pass back the returned "next" to poll without gaps. POST plays
+ * a hal_sim_run() script from a form-encoded "script" field, e.g.
+ * "script=k1234%23", so load and soak tests can type on the keypad.
+ */
+esp_err_t sim_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
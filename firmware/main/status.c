@@ -0,0 +1,219 @@
+#include "status.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_random.h>
+#include <esp_log.h>
+
+#include "http_auth.h"
+#include "http_server.h"
+#include "json_writer.h"
+
+static const char *TAG = "status";
+
+/* "\"<boot id>-<version>\"" */
+#define STATUS_ETAG_MAX (24)
+#define STATUS_BODY_MAX (128)
+
+/*
+ * Snapshots are rebuilt into the next slot of a small ring and then published
+ * by swapping s_current. Readers never lock: they copy the current slot and
+ * retry if it was republished meanwhile, since a slow client can outlast
+ * STATUS_SLOTS - 1 newer snapshots and see its slot rewritten.
+ */
+#define STATUS_SLOTS (4)
+
+typedef struct
+{
+  uint32_t version;
+  size_t etag_len;
+  size_t body_len;
+  char etag[STATUS_ETAG_MAX];
+  char body[STATUS_BODY_MAX];
+} status_snapshot_t;
+
+typedef struct
+{
+  bool door_open;
+  bool door_locked;
+  status_lockout_t lockout;
+  uint32_t cooldown_until_s;
+} status_state_t;
+
+static status_snapshot_t s_slots[STATUS_SLOTS];
+static _Atomic(status_snapshot_t *) s_current = NULL;
+
+/* writers only; guards s_state and the ring position */
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buf;
+static status_state_t s_state = {.door_open = false, .door_locked = true, .lockout = STATUS_LOCKOUT_NONE};
+static uint32_t s_version = 0;
+static uint32_t s_boot_id = 0;
+
+static const char *lockout_name(status_lockout_t lockout)
+{
+  switch (lockout)
+  {
+  case STATUS_LOCKOUT_COOLDOWN:
+    return "cooldown";
+  case STATUS_LOCKOUT_LOCKED:
+    return "locked";
+  default:
+    return "none";
+  }
+}
+
+/* Call with s_lock held. The version is written first, so a reader copying this slot sees it change */
+static void rebuild(void)
+{
+  status_snapshot_t *snap = &s_slots[++s_version % STATUS_SLOTS];
+
+  snap->version = s_version;
+  atomic_thread_fence(memory_order_release);
+  snap->etag_len = snprintf(snap->etag, sizeof(snap->etag), "\"%08" PRIx32 "-%" PRIu32 "\"", s_boot_id, s_version);
+
+  // the slot is the final destination; no flush function, overflow is an error
+  json_writer_t w;
+  json_writer_init(&w, snap->body, sizeof(snap->body), NULL, NULL);
+  json_obj_begin(&w);
+  json_kv_uint(&w, "version", s_version);
+  json_kv_str(&w, "door", s_state.door_open ? "open" : "closed");
+  json_kv_str(&w, "lock", s_state.door_locked ? "locked" : "unlocked");
+  json_kv_str(&w, "lockout", lockout_name(s_state.lockout));
+  json_kv_uint(&w, "cooldown_until", s_state.cooldown_until_s);
+  json_obj_end(&w);
+
+  if (w.err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Snapshot exceeds %d bytes, keeping previous", STATUS_BODY_MAX);
+    return;
+  }
+  snap->body_len = w.len;
+
+  atomic_store(&s_current, snap);
+}
+
+void status_init(void)
+{
+  if (s_lock)
+  {
+    return;
+  }
+
+  // distinguishes versions across reboots, so a stale ETag never matches
+  s_boot_id = esp_random();
+  s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  rebuild();
+  xSemaphoreGive(s_lock);
+}
+
+void status_set_door(bool open, bool locked)
+{
+  if (!s_lock)
+  {
+    return;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  if (s_state.door_open != open || s_state.door_locked != locked)
+  {
+    s_state.door_open = open;
+    s_state.door_locked = locked;
+    rebuild();
+  }
+  xSemaphoreGive(s_lock);
+}
+
+void status_set_lockout(status_lockout_t lockout, uint32_t cooldown_until_s)
+{
+  if (!s_lock)
+  {
+    return;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  if (s_state.lockout != lockout || s_state.cooldown_until_s != cooldown_until_s)
+  {
+    s_state.lockout = lockout;
+    s_state.cooldown_until_s = cooldown_until_s;
+    rebuild();
+  }
+  xSemaphoreGive(s_lock);
+}
+
+/* --------------------------------- HANDLER -------------------------------- */
+
+/* Seqlock-style read: the copy is good if the same slot is still current with the same version */
+static bool snapshot_copy(status_snapshot_t *copy)
+{
+  while (true)
+  {
+    const status_snapshot_t *snap = atomic_load(&s_current);
+    if (!snap)
+    {
+      return false;
+    }
+
+    uint32_t version = snap->version;
+    atomic_thread_fence(memory_order_acquire);
+    memcpy(copy, snap, sizeof(*copy));
+    atomic_thread_fence(memory_order_acquire);
+
+    if (atomic_load(&s_current) == snap && snap->version == version)
+    {
+      return true;
+    }
+  }
+}
+
+static esp_err_t status_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  // a stack copy: httpd keeps only the ETag pointer, and the send can outlast the slot
+  status_snapshot_t snap;
+  if (!snapshot_copy(&snap))
+  {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status not initialized");
+  }
+
+  // clients must revalidate, but an unchanged snapshot costs only this compare
+  httpd_resp_set_hdr(req, "ETag", snap.etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+  char if_none_match[STATUS_ETAG_MAX];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+      strcmp(if_none_match, snap.etag) == 0)
+  {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, snap.body, snap.body_len);
+}
+
+static const httpd_uri_t status_uri = {
+    .uri = "/status",
+    .method = HTTP_GET,
+    .handler = status_get_handler,
+    .user_ctx = NULL};
+
+esp_err_t status_register(httpd_handle_t server)
+{
+  if (!s_lock)
+  {
+    ESP_LOGW(TAG, "status_init() not called, initializing now");
+    status_init();
+  }
+  return http_server_register(server, &status_uri);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+typedef enum
+{
+  STATUS_LOCKOUT_NONE,
+  STATUS_LOCKOUT_COOLDOWN,
+  STATUS_LOCKOUT_LOCKED,
+} status_lockout_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Build the first snapshot; call once at the start of app_main */
+void status_init(void);
+
+/*
+ * State setters. Each one rebuilds the JSON snapshot and bumps its version,
+ * but only when the value actually changed. Safe to call from any task.
+ */
+void status_set_door(bool open, bool locked);
+void status_set_lockout(status_lockout_t lockout, uint32_t cooldown_until_s);
+
+/**
+ * @brief Register GET /status
+ *
+ * Serves the current snapshot as-is with a strong ETag and answers a matching
+ * If-None-Match with 304, so a poll costs a header compare: no formatting and
+ * no locks on the read path.
+ */
+esp_err_t status_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
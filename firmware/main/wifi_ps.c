@@ -0,0 +1,251 @@
+#include "wifi_ps.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <ping/ping_sock.h>
+
+#include "wifi_power.h"
+#include "http_auth.h"
+#include "http_server.h"
+#include "http_query.h"
+#include "json_writer.h"
+
+static const char *TAG = "wifi_ps";
+
+/* ------------------------------- MEASUREMENT ------------------------------ */
+
+#if CONFIG_LOCKBOX_WIFI_PS_MEASURE
+
+static wifi_ps_stats_t s_stats[WIFI_PS_MODES];
+static int64_t s_last_sample;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_ping_handle_t s_ping;
+
+/* charge the time since the last probe, and the probe itself, to the mode active now */
+static void record(bool replied, uint32_t rtt_ms)
+{
+  wifi_ps_type_t mode;
+  uint16_t listen_interval;
+  wifi_power_get(&mode, &listen_interval);
+  if ((unsigned)mode >= WIFI_PS_MODES)
+  {
+    return;
+  }
+
+  int64_t now = esp_timer_get_time();
+
+  taskENTER_CRITICAL(&s_stats_lock);
+  wifi_ps_stats_t *s = &s_stats[mode];
+  s->in_mode_ms += (now - s_last_sample) / 1000;
+  s_last_sample = now;
+  if (replied)
+  {
+    s->probes++;
+    s->rtt_sum_ms += rtt_ms;
+    if (rtt_ms > s->rtt_max_ms)
+    {
+      s->rtt_max_ms = rtt_ms;
+    }
+  }
+  else
+  {
+    s->lost++;
+  }
+  taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void on_ping_success(esp_ping_handle_t hdl, void *args)
+{
+  uint32_t elapsed_ms = 0;
+  esp_ping_get_profile(hdl, ESP_PING_PROF_TIMEGAP, &elapsed_ms, sizeof(elapsed_ms));
+  record(true, elapsed_ms);
+}
+
+static void on_ping_timeout(esp_ping_handle_t hdl, void *args)
+{
+  record(false, 0);
+}
+
+static void measure_start(void)
+{
+  if (s_ping)
+  {
+    return;
+  }
+
+  esp_netif_ip_info_t ip;
+  esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  if (!netif || esp_netif_get_ip_info(netif, &ip) != ESP_OK || ip.gw.addr == 0)
+  {
+    ESP_LOGW(TAG, "No gateway, power save measurement not started");
+    return;
+  }
+
+  esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+  config.target_addr.type = IPADDR_TYPE_V4;
+  config.target_addr.u_addr.ip4.addr = ip.gw.addr;
+  config.count = ESP_PING_COUNT_INFINITE;
+  config.interval_ms = CONFIG_LOCKBOX_WIFI_PS_MEASURE_INTERVAL;
+  config.data_size = 32;
+
+  esp_ping_callbacks_t callbacks = {
+      .on_ping_success = on_ping_success,
+      .on_ping_timeout = on_ping_timeout,
+  };
+
+  s_last_sample = esp_timer_get_time();
+  if (esp_ping_new_session(&config, &callbacks, &s_ping) != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to create gateway probe");
+    s_ping = NULL;
+    return;
+  }
+  esp_ping_start(s_ping);
+  ESP_LOGI(TAG, "Probing gateway " IPSTR " every %d ms", IP2STR(&ip.gw), CONFIG_LOCKBOX_WIFI_PS_MEASURE_INTERVAL);
+}
+
+bool wifi_ps_get_stats(wifi_ps_stats_t stats[WIFI_PS_MODES])
+{
+  taskENTER_CRITICAL(&s_stats_lock);
+  memcpy(stats, s_stats, sizeof(s_stats));
+  taskEXIT_CRITICAL(&s_stats_lock);
+  return s_ping != NULL;
+}
+
+#else
+
+static void measure_start(void)
+{
+}
+
+bool wifi_ps_get_stats(wifi_ps_stats_t stats[WIFI_PS_MODES])
+{
+  return false;
+}
+
+#endif
+
+/* -------------------------------- HANDLERS -------------------------------- */
+
+static esp_err_t send_power(httpd_req_t *req)
+{
+  wifi_ps_type_t mode;
+  uint16_t listen_interval;
+  wifi_power_get(&mode, &listen_interval);
+
+  char buf[JSON_CHUNK_SIZE];
+  json_writer_t w;
+  json_resp_init(&w, req, buf, sizeof(buf));
+  json_obj_begin(&w);
+  json_kv_str(&w, "mode", wifi_power_name(mode));
+  json_kv_uint(&w, "listen_interval", listen_interval);
+
+  wifi_ps_stats_t stats[WIFI_PS_MODES];
+  if (wifi_ps_get_stats(stats))
+  {
+    json_key(&w, "measure");
+    json_arr_begin(&w);
+    for (int i = 0; i < WIFI_PS_MODES; i++)
+    {
+      json_obj_begin(&w);
+      json_kv_str(&w, "mode", wifi_power_name((wifi_ps_type_t)i));
+      json_kv_uint(&w, "probes", stats[i].probes);
+      json_kv_uint(&w, "lost", stats[i].lost);
+      json_kv_uint(&w, "rtt_avg_ms", stats[i].probes ? (uint32_t)(stats[i].rtt_sum_ms / stats[i].probes) : 0);
+      json_kv_uint(&w, "rtt_max_ms", stats[i].rtt_max_ms);
+      json_kv_uint(&w, "in_mode_s", (uint32_t)(stats[i].in_mode_ms / 1000));
+      json_obj_end(&w);
+    }
+    json_arr_end(&w);
+  }
+
+  json_obj_end(&w);
+  return json_resp_end(&w);
+}
+
+static esp_err_t power_get_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+  return send_power(req);
+}
+
+static esp_err_t power_post_handler(httpd_req_t *req)
+{
+  if (!http_auth_check(req))
+  {
+    return ESP_OK;
+  }
+
+  wifi_ps_type_t mode;
+  uint16_t listen_interval;
+  wifi_power_get(&mode, &listen_interval);
+
+  http_query_t query;
+  http_query_parse_req(&query, req);
+
+  char value[16];
+  if (http_query_value(&query, "mode", value, sizeof(value)) == ESP_OK)
+  {
+    int i = 0;
+    while (i < WIFI_PS_MODES && strcmp(value, wifi_power_name((wifi_ps_type_t)i)) != 0)
+    {
+      i++;
+    }
+    if (i == WIFI_PS_MODES)
+    {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "mode must be none, min_modem or max_modem");
+    }
+    mode = (wifi_ps_type_t)i;
+  }
+
+  if (http_query_value(&query, "listen", value, sizeof(value)) == ESP_OK)
+  {
+    char *end;
+    unsigned long n = strtoul(value, &end, 10);
+    if (*end != '\0' || n < 1 || n > WIFI_LISTEN_INTERVAL_MAX)
+    {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "listen must be 1-100");
+    }
+    listen_interval = (uint16_t)n;
+  }
+
+  esp_err_t err = wifi_power_set(mode, listen_interval);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to set power save (%s)", esp_err_to_name(err));
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set power save");
+  }
+  return send_power(req);
+}
+
+static const httpd_uri_t power_get_uri = {
+    .uri = "/wifi/power",
+    .method = HTTP_GET,
+    .handler = power_get_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t power_post_uri = {
+    .uri = "/wifi/power",
+    .method = HTTP_POST,
+    .handler = power_post_handler,
+    .user_ctx = NULL};
+
+esp_err_t wifi_ps_register(httpd_handle_t server)
+{
+  measure_start();
+
+  esp_err_t err = http_server_register(server, &power_get_uri);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+  return http_server_register(server, &power_post_uri);
+}
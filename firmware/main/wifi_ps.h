@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/* WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM */
+#define WIFI_PS_MODES (3)
+
+/* What a power save mode cost while it was active */
+typedef struct
+{
+  uint32_t probes;      // gateway echo replies received
+  uint32_t lost;        // probes that timed out
+  uint64_t rtt_sum_ms;  // round trips, for the mean
+  uint32_t rtt_max_ms;
+  uint64_t in_mode_ms;  // wall-clock time in this mode while measuring, not radio-on time
+} wifi_ps_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register GET and POST /wifi/power
+ *
+ * GET reports the current mode and listen interval, plus the per-mode
+ * measurements when LOCKBOX_WIFI_PS_MEASURE is on. POST switches at runtime:
+ * "?mode=none|min_modem|max_modem&listen=N", either parameter optional.
+ *
+ * With LOCKBOX_WIFI_PS_MEASURE the first call starts pinging the gateway. The
+ * probe sees the station's own round trips, not the delay an AP adds by
+ * buffering a request until the station wakes: that happens before the
+ * request reaches the box, so it is timed from the client, with
+ * test/host/ps_latency.py. Radio-on time is not measured; in_mode is
+ * wall-clock time.
+ */
+esp_err_t wifi_ps_register(httpd_handle_t server);
+
+/** @brief Copy the per-mode measurements, indexed by wifi_ps_type_t; false if not measuring */
+bool wifi_ps_get_stats(wifi_ps_stats_t stats[WIFI_PS_MODES]);
+
+#ifdef __cplusplus
+}
+#endif
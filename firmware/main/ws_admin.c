@@ -0,0 +1,395 @@
+#include "ws_admin.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <esp_log.h>
+#include <esp_check.h>
+#include "sdkconfig.h"
+
+#include "lockbox_api.h"
+#include "http_async.h"
+#include "http_auth.h"
+#include "http_server.h"
+
+static const char *TAG = "ws_admin";
+
+#if CONFIG_LOCKBOX_WS_ADMIN
+
+#define WS_ADMIN_REQ_HDR_LEN (4)
+#define WS_ADMIN_RESP_HDR_LEN (5)
+#define WS_ADMIN_SECRET_MAX (16)
+
+/* SET_SECRET commits to NVS, so it runs on an async worker and is answered later */
+#define WS_ADMIN_SECRET_JOBS (2)
+
+/* internal status: the response is sent by the job, not in the request's frame */
+#define WS_ADMIN_STATUS_PENDING (0xFF)
+
+/* worst case: a frame packed with payload-less requests */
+#define WS_ADMIN_TX_MAX ((CONFIG_LOCKBOX_WS_MAX_FRAME / WS_ADMIN_REQ_HDR_LEN) * WS_ADMIN_RESP_HDR_LEN)
+
+static httpd_handle_t s_server = NULL;
+
+/* session context of sockets that passed the auth check on their upgrade */
+static uint8_t s_authenticated;
+
+/* key echo subscribers; only touched on the httpd task */
+static int s_echo_fds[CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS];
+static volatile int s_echo_count = 0;
+
+typedef struct
+{
+  atomic_bool busy;
+  httpd_handle_t server;
+  int fd;
+  uint16_t id;
+  uint8_t status;
+  char secret[WS_ADMIN_SECRET_MAX];
+} ws_admin_secret_job_t;
+
+static ws_admin_secret_job_t s_secret_jobs[WS_ADMIN_SECRET_JOBS];
+
+/* ------------------------------- KEY ECHO -------------------------------- */
+
+static bool echo_subscribe(int fd)
+{
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    if (s_echo_fds[i] == fd)
+    {
+      return true;
+    }
+  }
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    if (s_echo_fds[i] < 0)
+    {
+      s_echo_fds[i] = fd;
+      s_echo_count++;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void echo_unsubscribe(int fd)
+{
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    if (s_echo_fds[i] == fd)
+    {
+      s_echo_fds[i] = -1;
+      s_echo_count--;
+    }
+  }
+}
+
+/* Runs on the httpd task via httpd_queue_work() */
+static void key_echo_work(void *arg)
+{
+  uint8_t msg[WS_ADMIN_RESP_HDR_LEN + 1] = {WS_ADMIN_EVT_KEY, 0, 0, WS_ADMIN_STATUS_OK, 1, (uint8_t)(uintptr_t)arg};
+
+  httpd_ws_frame_t frame = {
+      .final = true,
+      .type = HTTPD_WS_TYPE_BINARY,
+      .payload = msg,
+      .len = sizeof(msg),
+  };
+
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    int fd = s_echo_fds[i];
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    // the socket may have been closed or reused since it subscribed
+    if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+        httpd_ws_send_frame_async(s_server, fd, &frame) != ESP_OK)
+    {
+      ESP_LOGI(TAG, "Dropping key echo subscriber on socket %d", fd);
+      echo_unsubscribe(fd);
+    }
+  }
+}
+
+/* ------------------------------- SET SECRET ------------------------------- */
+
+/* Runs on the httpd task via httpd_queue_work(), so it never interleaves with a handler's frame */
+static void secret_reply_work(void *arg)
+{
+  ws_admin_secret_job_t *job = arg;
+  uint8_t msg[WS_ADMIN_RESP_HDR_LEN] = {WS_ADMIN_OP_SET_SECRET | WS_ADMIN_RESP_FLAG, (uint8_t)job->id,
+                                        (uint8_t)(job->id >> 8), job->status, 0};
+
+  httpd_ws_frame_t frame = {
+      .final = true,
+      .type = HTTPD_WS_TYPE_BINARY,
+      .payload = msg,
+      .len = sizeof(msg),
+  };
+
+  // the client may have gone away while the secret was written
+  if (httpd_ws_get_fd_info(job->server, job->fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+      httpd_ws_send_frame_async(job->server, job->fd, &frame) != ESP_OK)
+  {
+    ESP_LOGI(TAG, "Dropping SET_SECRET response for socket %d", job->fd);
+  }
+  atomic_store(&job->busy, false);
+}
+
+/* Runs on an http_async worker: the NVS write and commit stay off the httpd task */
+static void secret_work(void *arg)
+{
+  ws_admin_secret_job_t *job = arg;
+
+  esp_err_t err = lockbox_set_secret(job->secret);
+  memset(job->secret, 0, sizeof(job->secret));
+  job->status = err == ESP_OK ? WS_ADMIN_STATUS_OK : WS_ADMIN_STATUS_FAIL;
+
+  if (httpd_queue_work(job->server, secret_reply_work, job) != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Failed to queue SET_SECRET response for socket %d", job->fd);
+    atomic_store(&job->busy, false);
+  }
+}
+
+static uint8_t secret_submit(int fd, uint16_t id, const uint8_t *payload, size_t len)
+{
+  if (len == 0 || len >= WS_ADMIN_SECRET_MAX)
+  {
+    return WS_ADMIN_STATUS_BAD_REQUEST;
+  }
+
+  for (size_t i = 0; i < WS_ADMIN_SECRET_JOBS; i++)
+  {
+    ws_admin_secret_job_t *job = &s_secret_jobs[i];
+    if (atomic_exchange(&job->busy, true))
+    {
+      continue;
+    }
+
+    job->server = s_server;
+    job->fd = fd;
+    job->id = id;
+    memcpy(job->secret, payload, len);
+    job->secret[len] = '\0';
+
+    if (http_async_queue_work(secret_work, job) != ESP_OK)
+    {
+      memset(job->secret, 0, sizeof(job->secret));
+      atomic_store(&job->busy, false);
+      return WS_ADMIN_STATUS_BUSY;
+    }
+    return WS_ADMIN_STATUS_PENDING;
+  }
+  return WS_ADMIN_STATUS_BUSY;
+}
+
+/* -------------------------------- COMMANDS -------------------------------- */
+
+static uint8_t ws_admin_execute(int fd, uint8_t op, uint16_t id, const uint8_t *payload, size_t len)
+{
+  switch (op)
+  {
+  case WS_ADMIN_OP_PING:
+    return WS_ADMIN_STATUS_OK;
+
+  case WS_ADMIN_OP_UNLOCK:
+    return lockbox_unlock() == ESP_OK ? WS_ADMIN_STATUS_OK : WS_ADMIN_STATUS_FAIL;
+
+  case WS_ADMIN_OP_RELOCK:
+    return lockbox_relock() == ESP_OK ? WS_ADMIN_STATUS_OK : WS_ADMIN_STATUS_FAIL;
+
+  case WS_ADMIN_OP_SET_SECRET:
+    return secret_submit(fd, id, payload, len);
+
+  case WS_ADMIN_OP_CLEAR_LOCKOUT:
+    return lockbox_clear_lockout() == ESP_OK ? WS_ADMIN_STATUS_OK : WS_ADMIN_STATUS_FAIL;
+
+  case WS_ADMIN_OP_KEY_ECHO:
+    if (len != 1)
+    {
+      return WS_ADMIN_STATUS_BAD_REQUEST;
+    }
+    if (payload[0])
+    {
+      return echo_subscribe(fd) ? WS_ADMIN_STATUS_OK : WS_ADMIN_STATUS_BUSY;
+    }
+    echo_unsubscribe(fd);
+    return WS_ADMIN_STATUS_OK;
+
+  default:
+    return WS_ADMIN_STATUS_UNKNOWN_OP;
+  }
+}
+
+/* -------------------------------- HANDLER -------------------------------- */
+
+/* the marker is static, httpd must not free() it when the socket closes */
+static void session_closed(void *ctx)
+{
+}
+
+static esp_err_t ws_admin_handler(httpd_req_t *req)
+{
+  if (req->method == HTTP_GET)
+  {
+    // httpd has already sent 101, so there is no 401 to send; failing makes httpd close the socket
+    if (!http_auth_valid(req))
+    {
+      ESP_LOGI(TAG, "Rejected unauthenticated admin channel on socket %d", httpd_req_to_sockfd(req));
+      return ESP_FAIL;
+    }
+
+    req->sess_ctx = &s_authenticated;
+    req->free_ctx = session_closed;
+    ESP_LOGI(TAG, "Admin channel opened on socket %d", httpd_req_to_sockfd(req));
+    return ESP_OK;
+  }
+
+  // data frames carry no headers; only sockets authenticated on their upgrade may send them
+  if (req->sess_ctx != &s_authenticated)
+  {
+    ESP_LOGW(TAG, "Frame on unauthenticated socket %d, closing", httpd_req_to_sockfd(req));
+    return ESP_FAIL;
+  }
+
+  uint8_t rx[CONFIG_LOCKBOX_WS_MAX_FRAME];
+  uint8_t tx[WS_ADMIN_TX_MAX];
+
+  // first call only fills in the frame length
+  httpd_ws_frame_t frame = {0};
+  ESP_RETURN_ON_ERROR(httpd_ws_recv_frame(req, &frame, 0), TAG, "Failed to read frame header");
+  ESP_RETURN_ON_FALSE(frame.len <= sizeof(rx), ESP_ERR_INVALID_SIZE, TAG, "Frame too large (%u bytes)", (unsigned)frame.len);
+
+  frame.payload = rx;
+  ESP_RETURN_ON_ERROR(httpd_ws_recv_frame(req, &frame, frame.len), TAG, "Failed to read frame payload");
+
+  if (frame.type != HTTPD_WS_TYPE_BINARY)
+  {
+    ESP_LOGD(TAG, "Ignoring non-binary frame (type %d)", frame.type);
+    return ESP_OK;
+  }
+
+  int fd = httpd_req_to_sockfd(req);
+  size_t in = 0;
+  size_t out = 0;
+
+  // execute every pipelined request in the frame, answering each in order
+  while (in + WS_ADMIN_REQ_HDR_LEN <= frame.len)
+  {
+    uint8_t op = rx[in];
+    uint8_t id_lo = rx[in + 1];
+    uint8_t id_hi = rx[in + 2];
+    size_t len = rx[in + 3];
+    in += WS_ADMIN_REQ_HDR_LEN;
+
+    uint8_t status;
+    if (in + len > frame.len)
+    {
+      // truncated request; nothing after it can be trusted
+      status = WS_ADMIN_STATUS_BAD_REQUEST;
+      in = frame.len;
+    }
+    else
+    {
+      status = ws_admin_execute(fd, op, id_lo | (id_hi << 8), rx + in, len);
+      in += len;
+    }
+
+    if (status == WS_ADMIN_STATUS_PENDING)
+    {
+      continue;
+    }
+
+    tx[out++] = op | WS_ADMIN_RESP_FLAG;
+    tx[out++] = id_lo;
+    tx[out++] = id_hi;
+    tx[out++] = status;
+    tx[out++] = 0;
+  }
+
+  if (out == 0)
+  {
+    return ESP_OK;
+  }
+
+  httpd_ws_frame_t resp = {
+      .final = true,
+      .type = HTTPD_WS_TYPE_BINARY,
+      .payload = tx,
+      .len = out,
+  };
+  return httpd_ws_send_frame(req, &resp);
+}
+
+static const httpd_uri_t ws_admin_uri = {
+    .uri = "/ws",
+    .method = HTTP_GET,
+    .handler = ws_admin_handler,
+    .user_ctx = NULL,
+    .is_websocket = true};
+
+/* ---------------------------------- API ---------------------------------- */
+
+esp_err_t ws_admin_register(httpd_handle_t server)
+{
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    s_echo_fds[i] = -1;
+  }
+  s_echo_count = 0;
+
+  s_server = server;
+  return http_server_register(server, &ws_admin_uri);
+}
+
+void ws_admin_unregister(void)
+{
+  s_server = NULL;
+  for (size_t i = 0; i < CONFIG_LOCKBOX_WS_MAX_ECHO_CLIENTS; i++)
+  {
+    s_echo_fds[i] = -1;
+  }
+  s_echo_count = 0;
+}
+
+void ws_admin_key_echo(char key)
+{
+  httpd_handle_t server = s_server;
+  if (!server || s_echo_count == 0)
+  {
+    return;
+  }
+
+  if (key >= '0' && key <= '9')
+  {
+    key = 'x';
+  }
+
+  if (httpd_queue_work(server, key_echo_work, (void *)(uintptr_t)(uint8_t)key) != ESP_OK)
+  {
+    ESP_LOGW(TAG, "Failed to queue key echo");
+  }
+}
+
+#else
+
+esp_err_t ws_admin_register(httpd_handle_t server)
+{
+  ESP_LOGD(TAG, "WebSocket admin channel disabled");
+  return ESP_OK;
+}
+
+void ws_admin_unregister(void)
+{
+}
+
+void ws_admin_key_echo(char key)
+{
+}
+
+#endif // CONFIG_LOCKBOX_WS_ADMIN
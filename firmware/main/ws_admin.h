@@ -0,0 +1,58 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/*
+ * Binary admin protocol carried in WebSocket binary frames on /ws.
+ *
+ * A frame holds one or more back-to-back requests, so clients can pipeline:
+ *
+ *   request   [op:u8][id:u16 LE][len:u8][payload:len]
+ *   response  [op|0x80:u8][id:u16 LE][status:u8][len:u8][payload:len]
+ *
+ * Every request gets exactly one response carrying the same id. Responses to
+ * the requests of one frame are sent back in order in a single frame, except
+ * SET_SECRET: it commits to flash on a worker and is answered in its own frame
+ * once written, so match responses by id. With too many secret writes in
+ * flight it is answered WS_ADMIN_STATUS_BUSY straight away.
+ * Key echo events are pushed as [WS_ADMIN_EVT_KEY][0x0000][0][1][key].
+ */
+
+#define WS_ADMIN_OP_PING (0x00)
+#define WS_ADMIN_OP_UNLOCK (0x01)
+#define WS_ADMIN_OP_RELOCK (0x02)
+#define WS_ADMIN_OP_SET_SECRET (0x03)    // payload: ASCII digits
+#define WS_ADMIN_OP_CLEAR_LOCKOUT (0x04)
+#define WS_ADMIN_OP_KEY_ECHO (0x05)      // payload: 1 byte, 0 = off, 1 = on
+
+#define WS_ADMIN_RESP_FLAG (0x80)
+#define WS_ADMIN_EVT_KEY (0xE0)
+
+#define WS_ADMIN_STATUS_OK (0)
+#define WS_ADMIN_STATUS_BAD_REQUEST (1)
+#define WS_ADMIN_STATUS_FAIL (2)
+#define WS_ADMIN_STATUS_UNKNOWN_OP (3)
+#define WS_ADMIN_STATUS_BUSY (4)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Register the /ws admin endpoint (no-op unless CONFIG_LOCKBOX_WS_ADMIN) */
+esp_err_t ws_admin_register(httpd_handle_t server);
+
+/** @brief Forget the server handle and all key echo subscribers */
+void ws_admin_unregister(void);
+
+/**
+ * @brief Push a key press to every key echo subscriber
+ *
+ * Safe to call from any task; the send happens on the httpd task.
+ * Digits are reported as 'x' so passcodes never leave the box.
+ */
+void ws_admin_key_echo(char key);
+
+#ifdef __cplusplus
+}
+#endif
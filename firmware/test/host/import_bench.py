@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Bulk credential import throughput and RAM, CSV and binary, at growing list sizes.
+
+Replaces the user codes on the target: point it at a host build or a test box.
+For each size it reports codes per second (measured on the box and end to end)
+and how far free heap dipped below its value before the import, which should
+not grow with the list size; buffer_bytes is the fixed staging the box uses.
+The dip is read from the since-boot minimum, so run sizes smallest first.
+
+  ./import_bench.py --sizes 100,1000,10000,50000
+"""
+
+import argparse
+import json
+import random
+import struct
+import sys
+
+from lockbox_client import Target, add_target_args, parse_metrics
+
+
+def metrics(target, conn):
+    status, body, _ = target.request(conn, "GET", "/metrics")
+    if status != 200:
+        raise RuntimeError(f"/metrics: HTTP {status}")
+    return parse_metrics(body.decode())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--sizes", default="100,1000,10000", help="entries per import, comma separated")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    conn = target.connection(timeout=120)
+    rng = random.Random(1)
+    failed = False
+
+    print(f"{'format':>6} {'entries':>8} {'box/s':>9} {'e2e/s':>9} {'heap dip':>9} {'buffers':>8}")
+    for size in (int(n) for n in args.sizes.split(",")):
+        codes = [rng.randrange(10000) for _ in range(size)]
+        bodies = (
+            ("csv", "text/csv", "".join(f"{c:04d}\n" for c in codes).encode()),
+            ("binary", "application/octet-stream", b"".join(struct.pack("<H", c) for c in codes)),
+        )
+        for name, content_type, body in bodies:
+            free_before = metrics(target, conn).get("lockbox_heap_free_bytes", 0)
+            status, resp, elapsed = target.request(conn, "POST", "/credentials/import", body=body,
+                                                   content_type=content_type)
+            if status != 200:
+                print(f"{name:>6} {size:>8}  FAIL: HTTP {status} {resp[:80]!r}")
+                failed = True
+                continue
+            result = json.loads(resp)
+            low = metrics(target, conn).get("lockbox_heap_minimum_free_bytes", free_before)
+            dip = max(0, free_before - low)
+            print(f"{name:>6} {result['entries']:>8} {result['entries_per_s']:>9} "
+                  f"{result['entries'] / elapsed:>9.0f} {dip:>9.0f} {result['buffer_bytes']:>8}")
+
+    conn.close()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Load generator: concurrent clients against a box while dashboards hold streams open.
+
+Checks that the configured httpd profile serves every request while --events
+and --ws subscribers occupy sockets, and reports throughput and latency.
+
+  ./load.py --clients 4 --events 1 --ws 1 --duration 30
+"""
+
+import argparse
+import sys
+import threading
+import time
+from collections import Counter
+
+from lockbox_client import Target, add_target_args, summary
+
+
+def worker(target, paths, deadline, keepalive, latencies, errors, lock):
+    conn = target.connection()
+    i = 0
+    while time.monotonic() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        try:
+            status, _, elapsed = target.request(conn, "GET", path)
+        except Exception as e:  # noqa: BLE001 - every failure is a result here
+            with lock:
+                errors[type(e).__name__] += 1
+            conn.close()
+            conn = target.connection()
+            continue
+        with lock:
+            if status == 200:
+                latencies.append(elapsed)
+            else:
+                errors[f"HTTP {status}"] += 1
+        if not keepalive:
+            conn.close()
+            conn = target.connection()
+    conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--clients", type=int, default=4, help="concurrent request loops")
+    parser.add_argument("--duration", type=float, default=10, help="seconds")
+    parser.add_argument("--paths", default="/status,/hello,/metrics", help="comma separated, requested in turn")
+    parser.add_argument("--events", type=int, default=1, help="/events subscribers held open")
+    parser.add_argument("--ws", type=int, default=1, help="/ws sessions held open")
+    parser.add_argument("--no-keepalive", action="store_true", help="new connection per request")
+    parser.add_argument("--max-error-rate", type=float, default=0.0, help="fail above this fraction")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    streams = []
+    try:
+        for _ in range(args.events):
+            streams.append(target.open_events())
+        for _ in range(args.ws):
+            streams.append(target.open_ws())
+    except Exception as e:  # noqa: BLE001
+        print(f"FAIL: could not open streams: {e}")
+        return 1
+
+    latencies, errors, lock = [], Counter(), threading.Lock()
+    deadline = time.monotonic() + args.duration
+    paths = args.paths.split(",")
+    threads = [threading.Thread(target=worker,
+                                args=(target, paths, deadline, not args.no_keepalive, latencies, errors, lock))
+               for _ in range(args.clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    wall = time.monotonic() - start
+
+    for s in streams:
+        s.close()
+
+    total = len(latencies) + sum(errors.values())
+    s = summary(latencies)
+    print(f"{total} requests in {wall:.1f} s, {len(latencies) / wall:.1f} ok/s with "
+          f"{args.events} event and {args.ws} ws streams open")
+    print(f"latency p50 {s['p50_ms']:.1f} ms  p95 {s['p95_ms']:.1f} ms  "
+          f"p99 {s['p99_ms']:.1f} ms  max {s['max_ms']:.1f} ms")
+    for name, n in errors.most_common():
+        print(f"  {n} x {name}")
+
+    rate = sum(errors.values()) / total if total else 1.0
+    if rate > args.max_error_rate:
+        print(f"FAIL: error rate {rate:.1%}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,196 @@
+"""Minimal LockBox client for the host scripts: HTTP, /events and /ws, stdlib only.
+
+Works against the linux build (see "Host build" in the README) or a real box.
+"""
+
+import argparse
+import base64
+import http.client
+import os
+import socket
+import ssl
+import struct
+import time
+from urllib.parse import quote, urlsplit
+
+
+def add_target_args(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument("--url", default=os.environ.get("LOCKBOX_URL", "http://localhost"),
+                        help="base URL of the box (default $LOCKBOX_URL or http://localhost)")
+    parser.add_argument("--user", default=os.environ.get("LOCKBOX_USER", "admin"))
+    parser.add_argument("--password", default=os.environ.get("LOCKBOX_PASSWORD", ""),
+                        help="API password (default $LOCKBOX_PASSWORD)")
+
+
+def percentile(samples, p):
+    """p-th percentile of an already sorted list, nearest rank"""
+    if not samples:
+        return 0.0
+    k = max(0, min(len(samples) - 1, round(p / 100 * len(samples)) - 1))
+    return samples[k]
+
+
+def summary(samples):
+    s = sorted(samples)
+    return {
+        "n": len(s),
+        "p50_ms": percentile(s, 50) * 1000,
+        "p95_ms": percentile(s, 95) * 1000,
+        "p99_ms": percentile(s, 99) * 1000,
+        "max_ms": (s[-1] if s else 0) * 1000,
+    }
+
+
+class Target:
+    def __init__(self, url, user, password):
+        parts = urlsplit(url)
+        self.tls = parts.scheme == "https"
+        self.host = parts.hostname or "localhost"
+        self.port = parts.port or (443 if self.tls else 80)
+        self.auth = None
+        if password:
+            token = base64.b64encode(f"{user}:{password}".encode()).decode()
+            self.auth = "Basic " + token
+
+    @classmethod
+    def from_args(cls, args):
+        return cls(args.url, args.user, args.password)
+
+    def ssl_context(self):
+        # boxes use a self-signed per-device certificate
+        ctx = ssl.create_default_context()
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+        return ctx
+
+    def headers(self, extra=None):
+        h = {}
+        if self.auth:
+            h["Authorization"] = self.auth
+        if extra:
+            h.update(extra)
+        return h
+
+    def connection(self, timeout=10):
+        if self.tls:
+            return http.client.HTTPSConnection(self.host, self.port, timeout=timeout, context=self.ssl_context())
+        return http.client.HTTPConnection(self.host, self.port, timeout=timeout)
+
+    def request(self, conn, method, path, body=None, content_type=None):
+        """one request on conn; returns (status, body, seconds)"""
+        extra = {"Content-Type": content_type} if content_type else None
+        start = time.perf_counter()
+        conn.request(method, path, body=body, headers=self.headers(extra))
+        resp = conn.getresponse()
+        data = resp.read()
+        return resp.status, data, time.perf_counter() - start
+
+    def raw_socket(self, timeout=10):
+        sock = socket.create_connection((self.host, self.port), timeout=timeout)
+        if self.tls:
+            sock = self.ssl_context().wrap_socket(sock, server_hostname=self.host)
+        return sock
+
+    def _upgrade(self, path, extra):
+        sock = self.raw_socket()
+        lines = [f"GET {path} HTTP/1.1", f"Host: {self.host}"]
+        lines += [f"{k}: {v}" for k, v in self.headers(extra).items()]
+        sock.sendall(("\r\n".join(lines) + "\r\n\r\n").encode())
+        head = b""
+        while b"\r\n\r\n" not in head:
+            chunk = sock.recv(1024)
+            if not chunk:
+                raise ConnectionError(f"{path}: closed during handshake")
+            head += chunk
+        status = int(head.split(b" ", 2)[1])
+        return sock, status, head.split(b"\r\n\r\n", 1)[1]
+
+    def open_events(self):
+        """subscribe to /events; returns the socket, left open by the caller"""
+        sock, status, _ = self._upgrade("/events", {"Accept": "text/event-stream"})
+        if status != 200:
+            sock.close()
+            raise ConnectionError(f"/events: HTTP {status}")
+        return sock
+
+    def open_ws(self):
+        key = base64.b64encode(os.urandom(16)).decode()
+        sock, status, rest = self._upgrade("/ws", {
+            "Upgrade": "websocket",
+            "Connection": "Upgrade",
+            "Sec-WebSocket-Key": key,
+            "Sec-WebSocket-Version": "13",
+        })
+        if status != 101:
+            sock.close()
+            raise ConnectionError(f"/ws: HTTP {status}")
+        return WebSocket(sock, rest)
+
+
+class WebSocket:
+    def __init__(self, sock, pending=b""):
+        self.sock = sock
+        self.buf = pending
+
+    def send(self, payload, opcode=0x2):
+        """one masked frame, binary by default as /ws expects"""
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        n = len(payload)
+        if n < 126:
+            header += bytes([0x80 | n])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", n)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def _read(self, n):
+        while len(self.buf) < n:
+            chunk = self.sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("/ws closed")
+            self.buf += chunk
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def recv(self):
+        """payload of the next data frame; control frames are skipped"""
+        while True:
+            b0, b1 = self._read(2)
+            n = b1 & 0x7F
+            if n == 126:
+                n = struct.unpack(">H", self._read(2))[0]
+            elif n == 127:
+                n = struct.unpack(">Q", self._read(8))[0]
+            payload = self._read(n)
+            opcode = b0 & 0x0F
+            if opcode == 0x8:
+                raise ConnectionError("/ws closed by the box")
+            if opcode in (0x1, 0x2):
+                return payload
+
+    def close(self):
+        self.sock.close()
+
+
+def parse_metrics(text):
+    """unlabelled samples of a Prometheus text page, name -> float"""
+    values = {}
+    for line in text.splitlines():
+        if line.startswith("#") or "{" in line:
+            continue
+        parts = line.split()
+        if len(parts) == 2:
+            try:
+                values[parts[0]] = float(parts[1])
+            except ValueError:
+                pass
+    return values
+
+
+def post_sim(target, conn, script):
+    """queue a /sim script (linux build only)"""
+    status, body, _ = target.request(conn, "POST", "/sim", body="script=" + quote(script, safe=""),
+                                     content_type="application/x-www-form-urlencoded")
+    if status != 202:
+        raise RuntimeError(f"POST /sim: HTTP {status} {body!r}")
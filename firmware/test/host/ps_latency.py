@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""HTTP latency per Wi-Fi power save mode, timed from the client (esp32 box only).
+
+Switches the box through each mode with POST /wifi/power, lets it settle, then
+times GET requests spaced --gap seconds apart so the station dozes between
+them, as it would between real clients. The AP holds a request until the
+station wakes, so this includes the buffering delay the box itself can't see.
+The original mode and listen interval are restored at the end.
+
+  ./ps_latency.py --url http://lockbox.local --count 50 --gap 1 --listen 3
+"""
+
+import argparse
+import json
+import sys
+import time
+
+from lockbox_client import Target, add_target_args, summary
+
+MODES = ("none", "min_modem", "max_modem")
+
+
+def set_power(target, mode, listen):
+    conn = target.connection()
+    query = f"mode={mode}" + (f"&listen={listen}" if listen else "")
+    status, body, _ = target.request(conn, "POST", f"/wifi/power?{query}")
+    conn.close()
+    if status != 200:
+        raise RuntimeError(f"POST /wifi/power?{query}: HTTP {status} {body[:80]!r}")
+    return json.loads(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--modes", default=",".join(MODES), help="comma separated, measured in turn")
+    parser.add_argument("--listen", type=int, help="listen interval for every mode (default: keep the box's)")
+    parser.add_argument("--count", type=int, default=30, help="requests per mode")
+    parser.add_argument("--gap", type=float, default=1.0, help="seconds between requests, to let the station doze")
+    parser.add_argument("--settle", type=float, default=3.0, help="seconds after a switch before timing")
+    parser.add_argument("--path", default="/status")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    conn = target.connection()
+    status, body, _ = target.request(conn, "GET", "/wifi/power")
+    conn.close()
+    if status != 200:
+        print(f"FAIL: GET /wifi/power answered {status}, needs an esp32 build")
+        return 1
+    original = json.loads(body)
+
+    failed = 0
+    try:
+        for mode in args.modes.split(","):
+            state = set_power(target, mode, args.listen)
+            time.sleep(args.settle)
+            # a fresh connection per request, so keep-alive can't hold the station awake
+            samples = []
+            for _ in range(args.count):
+                time.sleep(args.gap)
+                conn = target.connection()
+                try:
+                    status, _, elapsed = target.request(conn, "GET", args.path)
+                except OSError:
+                    status = None
+                conn.close()
+                if status == 200:
+                    samples.append(elapsed)
+                else:
+                    failed += 1
+            s = summary(samples)
+            print(f"{mode:>9} listen {state['listen_interval']:>3} x{s['n']}: p50 {s['p50_ms']:6.1f} ms  "
+                  f"p95 {s['p95_ms']:6.1f} ms  p99 {s['p99_ms']:6.1f} ms  max {s['max_ms']:6.1f} ms", flush=True)
+    finally:
+        set_power(target, original["mode"], original["listen_interval"])
+
+    if failed:
+        print(f"FAIL: {failed} requests failed")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
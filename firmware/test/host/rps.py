@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Requests per second with Basic credentials on every request versus a /login token.
+
+Build with LOCKBOX_RATE_LIMIT off, or the limiter's 429s are what gets measured.
+
+  ./rps.py --clients 4 --duration 10 --path /status
+"""
+
+import argparse
+import json
+import sys
+import threading
+import time
+
+from lockbox_client import Target, add_target_args
+
+
+def run(target, path, clients, duration):
+    """(ok responses per second, other statuses) for one auth mode"""
+    counts = [0] * clients
+    failures = [0] * clients
+    deadline = time.monotonic() + duration
+
+    def loop(n):
+        conn = target.connection()
+        while time.monotonic() < deadline:
+            try:
+                status, _, _ = target.request(conn, "GET", path)
+            except OSError:
+                failures[n] += 1
+                conn.close()
+                conn = target.connection()
+                continue
+            if status == 200:
+                counts[n] += 1
+            else:
+                failures[n] += 1
+        conn.close()
+
+    threads = [threading.Thread(target=loop, args=(n,)) for n in range(clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return sum(counts) / (time.monotonic() - start), sum(failures)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--duration", type=float, default=10, help="seconds per mode")
+    parser.add_argument("--path", default="/status")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    if not target.auth:
+        print("FAIL: needs --password, both modes authenticate")
+        return 1
+
+    basic_rps, basic_fail = run(target, args.path, args.clients, args.duration)
+
+    conn = target.connection()
+    status, body, _ = target.request(conn, "POST", "/login")
+    conn.close()
+    if status != 200:
+        print(f"FAIL: /login answered {status}")
+        return 1
+    target.auth = "Bearer " + json.loads(body)["token"]
+    token_rps, token_fail = run(target, args.path, args.clients, args.duration)
+
+    print(f"GET {args.path}, {args.clients} clients, {args.duration:.0f} s each")
+    print(f"  basic: {basic_rps:8.1f} req/s  ({basic_fail} failed)")
+    print(f"  token: {token_rps:8.1f} req/s  ({token_fail} failed)")
+    if basic_rps:
+        print(f"  token/basic: {token_rps / basic_rps:.2f}x")
+    return 1 if basic_fail or token_fail else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Heap fragmentation soak: a million arena-backed requests, heap sampled from /metrics.
+
+Alternates /hello (Host header and query decoded into the request arena) and
+/basic_auth, and every --sample requests records free heap, the largest free
+block and fragmentation (1 - largest / free). Fails if fragmentation at the
+end exceeds --max-fragmentation or any request fails.
+
+On the linux build the heap figures come from the host allocator behind
+heap_caps, so compare runs against each other rather than with a device;
+--pid adds the process RSS for the same points.
+
+  ./soak.py --requests 1000000 --sample 50000 --pid $(pgrep -f LockBox.elf)
+"""
+
+import argparse
+import sys
+import time
+
+from lockbox_client import Target, add_target_args, parse_metrics
+
+HELLO = "/hello?query1=soak&query3=a%20b%2Bc&query2=x"
+
+
+def heap(target, conn):
+    status, body, _ = target.request(conn, "GET", "/metrics")
+    if status != 200:
+        raise RuntimeError(f"/metrics: HTTP {status}")
+    m = parse_metrics(body.decode())
+    free = m.get("lockbox_heap_free_bytes", 0)
+    largest = m.get("lockbox_heap_largest_free_block_bytes", 0)
+    return free, largest, (1 - largest / free) if free else 0.0
+
+
+def rss_kib(pid):
+    if not pid:
+        return None
+    with open(f"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--requests", type=int, default=1_000_000)
+    parser.add_argument("--sample", type=int, default=50_000, help="requests between heap samples")
+    parser.add_argument("--max-fragmentation", type=float, default=0.5)
+    parser.add_argument("--pid", type=int, help="host build process, to also report RSS")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    conn = target.connection()
+
+    def sample(done):
+        free, largest, frag = heap(target, conn)
+        rss = rss_kib(args.pid)
+        extra = f"  rss {rss} KiB" if rss is not None else ""
+        print(f"{done:>9} req  free {free:>8.0f}  largest {largest:>8.0f}  frag {frag:5.1%}{extra}", flush=True)
+        return frag
+
+    frag = sample(0)
+    start = time.monotonic()
+    failed = 0
+    for i in range(1, args.requests + 1):
+        path = HELLO if i % 2 else "/basic_auth"
+        try:
+            conn.request("GET", path, headers=target.headers())
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status != 200:
+                failed += 1
+        except OSError:
+            failed += 1
+            conn.close()
+            conn = target.connection()
+        if i % args.sample == 0 or i == args.requests:
+            frag = sample(i)
+
+    wall = time.monotonic() - start
+    print(f"{args.requests} requests in {wall:.0f} s ({args.requests / wall:.0f}/s), {failed} failed")
+    if failed or frag > args.max_fragmentation:
+        print(f"FAIL: {failed} failed, fragmentation {frag:.1%}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Full versus resumed TLS handshake time against an LOCKBOX_HTTPS build.
+
+Each sample opens a new TCP connection, completes the handshake and makes one
+GET so the server's session ticket arrives. Full handshakes start without a
+session, resumed ones offer the ticket from the previous connection; a
+"resumed" sample the server didn't actually resume is counted as a miss.
+
+  ./tls_handshake.py --url https://localhost --count 50
+"""
+
+import argparse
+import socket
+import sys
+import time
+
+from lockbox_client import Target, add_target_args, summary
+
+
+def connect(target, ctx, session=None):
+    """(handshake seconds, session to offer next, whether it was reused)"""
+    raw = socket.create_connection((target.host, target.port), timeout=10)
+    start = time.perf_counter()
+    sock = ctx.wrap_socket(raw, server_hostname=target.host, session=session)
+    elapsed = time.perf_counter() - start
+    reused = sock.session_reused
+    # TLS 1.3 tickets come after the handshake, so read a response before keeping the session
+    lines = ["GET /status HTTP/1.1", f"Host: {target.host}", "Connection: close"]
+    lines += [f"{k}: {v}" for k, v in target.headers().items()]
+    sock.sendall(("\r\n".join(lines) + "\r\n\r\n").encode())
+    while sock.recv(4096):
+        pass
+    next_session = sock.session
+    sock.close()
+    return elapsed, next_session, reused
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--count", type=int, default=30, help="handshakes per kind")
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    if not target.tls:
+        print("FAIL: needs an https:// --url")
+        return 1
+    ctx = target.ssl_context()
+
+    full = [connect(target, ctx)[0] for _ in range(args.count)]
+
+    resumed, misses = [], 0
+    _, session, _ = connect(target, ctx)
+    for _ in range(args.count):
+        elapsed, session, reused = connect(target, ctx, session)
+        if reused:
+            resumed.append(elapsed)
+        else:
+            misses += 1
+
+    for name, samples in (("full", full), ("resumed", resumed)):
+        s = summary(samples)
+        print(f"{name:>8} x{s['n']}: p50 {s['p50_ms']:.1f} ms  p95 {s['p95_ms']:.1f} ms  max {s['max_ms']:.1f} ms")
+    if misses:
+        print(f"FAIL: {misses} of {args.count} offered sessions were not resumed")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,245 @@
+/*
+ * Differential fuzz and benchmark of the URI encode/decode fast paths in
+ * main/protocol_examples_utils.c against the nginx state machines kept there.
+ *
+ *   cc -O2 -I../../main uri_fuzz.c ../../main/protocol_examples_utils.c -o uri_fuzz
+ *   ./uri_fuzz [iterations] [seed]     fuzz, exits 1 on the first mismatch
+ *   ./uri_fuzz --bench                 MB/s of both implementations
+ *
+ * References: example_uri_encode() is ngx_escape_uri(NGX_ESCAPE_URI_COMPONENT),
+ * example_uri_decode() is ngx_unescape_uri(NGX_UNESCAPE_URI), and
+ * example_uri_decode_arg() is ngx_unescape_uri(0) with every '+' a space.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "protocol_examples_utils.h"
+
+/* not in the header: the firmware only reaches them through the wrappers */
+uintptr_t ngx_escape_uri(u_char *dst, u_char *src, size_t size, unsigned int type);
+void ngx_unescape_uri(u_char **dst, u_char **src, size_t size, unsigned int type);
+
+#define NGX_ESCAPE_URI_COMPONENT (2)
+#define NGX_UNESCAPE_URI (1)
+
+#define MAX_INPUT (600)
+#define SENTINEL (0x5A)
+
+static uint64_t s_rng;
+
+static uint32_t rng(void)
+{
+  s_rng ^= s_rng << 13;
+  s_rng ^= s_rng >> 7;
+  s_rng ^= s_rng << 17;
+  return (uint32_t)(s_rng >> 32);
+}
+
+/* mostly the bytes the decoders act on, so escapes and their edge cases are common */
+static size_t random_input(u_char *buf)
+{
+  static const char interesting[] = "%%%??++09afAFgG/ &=#";
+  size_t len = rng() % 8 == 0 ? rng() % MAX_INPUT : rng() % 48;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    uint32_t r = rng() % 4;
+    if (r == 0)
+    {
+      buf[i] = (u_char)rng();
+    }
+    else if (r == 1)
+    {
+      buf[i] = 'a' + rng() % 26;
+    }
+    else
+    {
+      buf[i] = interesting[rng() % (sizeof(interesting) - 1)];
+    }
+  }
+  return len;
+}
+
+static void report(const char *what, const u_char *in, size_t len)
+{
+  printf("MISMATCH in %s, input (%zu bytes):", what, len);
+  for (size_t i = 0; i < len; i++)
+  {
+    printf(" %02x", in[i]);
+  }
+  printf("\n");
+}
+
+/* one input through every pair; src sits at a random offset to vary word alignment */
+static bool check(const u_char *input, size_t len)
+{
+  static u_char src_buf[MAX_INPUT + 16];
+  static u_char want[3 * MAX_INPUT + 16];
+  static u_char got[3 * MAX_INPUT + 16];
+  const size_t out_size = 3 * len + 8;
+
+  u_char *src = src_buf + rng() % 8;
+  memcpy(src, input, len);
+
+  // encode
+  memset(want, SENTINEL, out_size);
+  memset(got, SENTINEL, out_size);
+  size_t want_len = ngx_escape_uri(want, src, len, NGX_ESCAPE_URI_COMPONENT) - (uintptr_t)want;
+  size_t got_len = example_uri_encode((char *)got, (const char *)src, len);
+  if (want_len != got_len || memcmp(want, got, out_size) != 0)
+  {
+    report("example_uri_encode", input, len);
+    return false;
+  }
+
+  // decode as a path, compared past the output so stray writes show
+  memset(want, SENTINEL, len + 8);
+  memset(got, SENTINEL, len + 8);
+  u_char *d = want;
+  u_char *s = src;
+  ngx_unescape_uri(&d, &s, len, NGX_UNESCAPE_URI);
+  want_len = d - want;
+  example_uri_decode((char *)got, (const char *)src, len);
+  if (memcmp(want, got, len + 8) != 0)
+  {
+    report("example_uri_decode", input, len);
+    return false;
+  }
+
+  // decode as an argument, to a buffer, measured and in place
+  u_char plus[MAX_INPUT];
+  for (size_t i = 0; i < len; i++)
+  {
+    plus[i] = src[i] == '+' ? ' ' : src[i];
+  }
+  d = want;
+  s = plus;
+  ngx_unescape_uri(&d, &s, len, 0);
+  want_len = d - want;
+
+  got_len = example_uri_decode_arg((char *)got, (const char *)src, len);
+  size_t measured = example_uri_decode_arg(NULL, (const char *)src, len);
+  size_t in_place = example_uri_decode_arg((char *)src, (const char *)src, len);
+  if (got_len != want_len || measured != want_len || in_place != want_len ||
+      memcmp(want, got, want_len) != 0 || memcmp(want, src, want_len) != 0)
+  {
+    report("example_uri_decode_arg", input, len);
+    return false;
+  }
+
+  return true;
+}
+
+/* ---------------------------------- BENCH --------------------------------- */
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef enum
+{
+  OP_ENCODE,
+  OP_DECODE,
+} bench_op_t;
+
+static double run(bench_op_t op, bool fast, const u_char *in, size_t len, size_t rounds)
+{
+  static u_char out[3 * 4096];
+  volatile size_t sink = 0;
+
+  double start = now_s();
+  for (size_t r = 0; r < rounds; r++)
+  {
+    if (op == OP_ENCODE)
+    {
+      sink += fast ? example_uri_encode((char *)out, (const char *)in, len)
+                   : ngx_escape_uri(out, (u_char *)in, len, NGX_ESCAPE_URI_COMPONENT) - (uintptr_t)out;
+    }
+    else if (fast)
+    {
+      example_uri_decode((char *)out, (const char *)in, len);
+      sink += out[0];
+    }
+    else
+    {
+      u_char *d = out;
+      u_char *s = (u_char *)in;
+      ngx_unescape_uri(&d, &s, len, NGX_UNESCAPE_URI);
+      sink += d - out;
+    }
+  }
+  (void)sink;
+  return (double)len * rounds / (now_s() - start) / 1e6;
+}
+
+static void bench(void)
+{
+  static u_char clean[4096];
+  static u_char escaped[4096];
+  for (size_t i = 0; i < sizeof(clean); i++)
+  {
+    clean[i] = 'a' + i % 26;
+    // one escape in eight bytes, the shape of a form with a few symbols
+    escaped[i] = i % 8 == 0 ? '%' : i % 8 == 1 ? '2' : i % 8 == 2 ? '0' : 'a' + i % 26;
+  }
+
+  static const struct
+  {
+    const char *name;
+    bench_op_t op;
+    const u_char *in;
+    size_t len;
+  } cases[] = {
+      {"encode clean 64 B", OP_ENCODE, clean, 64},
+      {"encode clean 4 KiB", OP_ENCODE, clean, 4096},
+      {"decode clean 64 B", OP_DECODE, clean, 64},
+      {"decode clean 4 KiB", OP_DECODE, clean, 4096},
+      {"decode 1/8 escaped 4 KiB", OP_DECODE, escaped, 4096},
+  };
+
+  printf("%-26s %10s %10s %8s\n", "case", "nginx MB/s", "fast MB/s", "speedup");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    size_t rounds = (64u << 20) / cases[i].len;
+    double ref = run(cases[i].op, false, cases[i].in, cases[i].len, rounds);
+    double fast = run(cases[i].op, true, cases[i].in, cases[i].len, rounds);
+    printf("%-26s %10.0f %10.0f %7.1fx\n", cases[i].name, ref, fast, fast / ref);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+  {
+    bench();
+    return 0;
+  }
+
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+  s_rng = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x9E3779B97F4A7C15ull;
+  if (s_rng == 0)
+  {
+    s_rng = 1;
+  }
+
+  u_char input[MAX_INPUT];
+  for (unsigned long i = 0; i < iterations; i++)
+  {
+    size_t len = random_input(input);
+    if (!check(input, len))
+    {
+      return 1;
+    }
+  }
+  printf("%lu inputs, no mismatches\n", iterations);
+  return 0;
+}
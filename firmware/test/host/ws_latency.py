@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Round-trip latency of /ws admin commands (see main/ws_admin.h for the protocol).
+
+Sequential PINGs give the per-command round trip, pipelined batches show what
+one frame of many requests costs. With --key-echo (linux build) a '*' is
+pressed through /sim and the time until its echo arrives on /ws is reported too.
+
+  ./ws_latency.py --count 1000 --pipeline 16 --key-echo
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+from lockbox_client import Target, add_target_args, post_sim, summary
+
+OP_PING = 0x00
+OP_KEY_ECHO = 0x05
+RESP_FLAG = 0x80
+EVT_KEY = 0xE0
+
+
+def request(op, req_id, payload=b""):
+    return struct.pack("<BHB", op, req_id, len(payload)) + payload
+
+
+def responses(frame):
+    """(op, id, status) for each response packed into one frame"""
+    out = []
+    i = 0
+    while i + 5 <= len(frame):
+        op, req_id, status, n = struct.unpack_from("<BHBB", frame, i)
+        out.append((op, req_id, status))
+        i += 5 + n
+    return out
+
+
+def expect(ws, ids):
+    """read frames until every id in ids is answered, skipping key events"""
+    pending = set(ids)
+    while pending:
+        for op, req_id, status in responses(ws.recv()):
+            if op == EVT_KEY:
+                continue
+            if status != 0:
+                raise RuntimeError(f"request {req_id}: status {status}")
+            pending.discard(req_id)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    add_target_args(parser)
+    parser.add_argument("--count", type=int, default=500, help="sequential pings")
+    parser.add_argument("--pipeline", type=int, default=16, help="pings per frame in the batched run")
+    parser.add_argument("--key-echo", action="store_true", help="also time a /sim key press to its echo")
+    parser.add_argument("--key-count", type=int, default=20)
+    args = parser.parse_args()
+
+    target = Target.from_args(args)
+    ws = target.open_ws()
+
+    rtts = []
+    for i in range(args.count):
+        start = time.perf_counter()
+        ws.send(request(OP_PING, i & 0xFFFF))
+        expect(ws, [i & 0xFFFF])
+        rtts.append(time.perf_counter() - start)
+    s = summary(rtts)
+    print(f"ping x{s['n']}: p50 {s['p50_ms']:.2f} ms  p95 {s['p95_ms']:.2f} ms  "
+          f"p99 {s['p99_ms']:.2f} ms  max {s['max_ms']:.2f} ms")
+
+    batches = max(1, args.count // args.pipeline)
+    start = time.perf_counter()
+    for b in range(batches):
+        ids = [(b * args.pipeline + j) & 0xFFFF for j in range(args.pipeline)]
+        ws.send(b"".join(request(OP_PING, i) for i in ids))
+        expect(ws, ids)
+    wall = time.perf_counter() - start
+    total = batches * args.pipeline
+    print(f"pipelined x{total} ({args.pipeline}/frame): {wall / total * 1000:.3f} ms per command, "
+          f"{total / wall:.0f} commands/s")
+
+    if args.key_echo:
+        ws.send(request(OP_KEY_ECHO, 1, b"\x01"))
+        expect(ws, [1])
+        conn = target.connection()
+        echoes = []
+        for _ in range(args.key_count):
+            start = time.perf_counter()
+            post_sim(target, conn, "p20 k*")
+            while True:
+                frame = ws.recv()
+                if frame[0] == EVT_KEY:
+                    break
+            echoes.append(time.perf_counter() - start)
+            time.sleep(0.05)
+        conn.close()
+        s = summary(echoes)
+        print(f"key echo x{s['n']} (includes the 20 ms scripted press and debounce): "
+              f"p50 {s['p50_ms']:.1f} ms  max {s['max_ms']:.1f} ms")
+
+    ws.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())